@@ -52,6 +52,63 @@ const char* yamlTypeName(YAML::NodeType::value type)
     }
 }
 
+void loadLoggerParams(const YAML::Node& ylogger)
+{
+    auto checkFiedType = [&ylogger](const string& field, YAML::NodeType::value type)
+    {
+        if (ylogger[field].IsNull())
+            throw std::logic_error(
+                "For 'logger' node a field '" + field + "' can not be null");
+
+        if (ylogger[field].Type() != type)
+            throw std::logic_error(
+                "For 'logger' node a field '" + field + "' "
+                "must have type '" + yamlTypeName(type) + "'");
+    };
+
+    if (ylogger["queue_max_count"].IsDefined())
+    {
+        checkFiedType("queue_max_count", YAML::NodeType::Scalar);
+        logger().setQueueMaxCount(ylogger["queue_max_count"].as<int>());
+    }
+
+    if (ylogger["queue_max_bytes"].IsDefined())
+    {
+        checkFiedType("queue_max_bytes", YAML::NodeType::Scalar);
+        logger().setQueueMaxBytes(ylogger["queue_max_bytes"].as<int64_t>());
+    }
+
+    if (ylogger["overflow_policy"].IsDefined())
+    {
+        checkFiedType("overflow_policy", YAML::NodeType::Scalar);
+        string policy = ylogger["overflow_policy"].as<string>();
+
+        if (policy == "block")
+            logger().setOverflowPolicy(Logger::OverflowPolicy::Block);
+        else if (policy == "drop_new")
+            logger().setOverflowPolicy(Logger::OverflowPolicy::DropNew);
+        else if (policy == "drop_oldest")
+            logger().setOverflowPolicy(Logger::OverflowPolicy::DropOldest);
+        else
+            throw std::logic_error(
+                "For 'logger' node a field 'overflow_policy' has unknown "
+                "value '" + policy + "'");
+    }
+
+    if (ylogger["overflow_level"].IsDefined())
+    {
+        checkFiedType("overflow_level", YAML::NodeType::Scalar);
+        string level = ylogger["overflow_level"].as<string>();
+        logger().setOverflowLevel(levelFromString(level));
+    }
+
+    if (ylogger["overflow_report_time"].IsDefined())
+    {
+        checkFiedType("overflow_report_time", YAML::NodeType::Scalar);
+        logger().setOverflowReportTime(ylogger["overflow_report_time"].as<int>());
+    }
+}
+
 Filter::Ptr createFilter(const YAML::Node& yfilter)
 {
     auto checkFiedType = [&yfilter](const string& field, YAML::NodeType::value type)
@@ -86,12 +143,13 @@ Filter::Ptr createFilter(const YAML::Node& yfilter)
         && type != "func_name"
         && type != "file_name"
         && type != "thread_id"
-        && type != "content")
+        && type != "content"
+        && type != "pattern")
     {
         throw std::logic_error(
             "In a filter-node a field 'type' can take one of the following "
             "values: module_name, log_level, func_name, file_name, thread_id, "
-            "content. "
+            "content, pattern. "
             "Current value: " + type);
     }
 
@@ -119,6 +177,16 @@ Filter::Ptr createFilter(const YAML::Node& yfilter)
         followThreadContext = yfilter["follow_thread_context"].as<bool>();
     }
 
+    int threadContextTimeout = 3000;
+    if (yfilter["thread_context_timeout"].IsDefined())
+    {
+        checkFiedType("thread_context_timeout", YAML::NodeType::Scalar);
+        threadContextTimeout = yfilter["thread_context_timeout"].as<int>();
+    }
+    if (threadContextTimeout <= 0)
+        throw std::logic_error("In a filter-node a field 'thread_context_timeout' "
+                               "must be greater than zero");
+
     bool filteringNonameModules = false;
     if (yfilter["filtering_noname_modules"].IsDefined())
     {
@@ -178,6 +246,36 @@ Filter::Ptr createFilter(const YAML::Node& yfilter)
             contents.insert(ycont.as<string>());
     }
 
+    string target = "module";
+    if (yfilter["target"].IsDefined())
+    {
+        checkFiedType("target", YAML::NodeType::Scalar);
+        target = yfilter["target"].as<string>();
+    }
+    if ( !(target == "module" || target == "file"
+           || target == "func" || target == "content"))
+        throw std::logic_error("In a filter-node a field 'target' can take "
+                               "the values: 'module', 'file', 'func' or 'content'");
+
+    string syntax = "glob";
+    if (yfilter["syntax"].IsDefined())
+    {
+        checkFiedType("syntax", YAML::NodeType::Scalar);
+        syntax = yfilter["syntax"].as<string>();
+    }
+    if ( !(syntax == "glob" || syntax == "regex"))
+        throw std::logic_error("In a filter-node a field 'syntax' can take "
+                               "the values: 'glob' or 'regex'");
+
+    set<string> patterns;
+    if (yfilter["patterns"].IsDefined())
+    {
+        checkFiedType("patterns", YAML::NodeType::Sequence);
+        const YAML::Node& ypatterns = yfilter["patterns"];
+        for (const YAML::Node& ypattern : ypatterns)
+            patterns.insert(ypattern.as<string>());
+    }
+
     Filter::Ptr filter;
     if (type == "module_name")
     {
@@ -232,6 +330,32 @@ Filter::Ptr createFilter(const YAML::Node& yfilter)
 
         filter = filterCont;
     }
+    else if (type == "pattern")
+    {
+        FilterPattern::Ptr filterPattern {new FilterPattern};
+        filterPattern->setFilteringNoNameModules(filteringNonameModules);
+
+        if (target == "module")
+            filterPattern->setTarget(FilterPattern::Target::Module);
+        else if (target == "file")
+            filterPattern->setTarget(FilterPattern::Target::File);
+        else if (target == "func")
+            filterPattern->setTarget(FilterPattern::Target::Func);
+        else
+            filterPattern->setTarget(FilterPattern::Target::Content);
+
+        filterPattern->setSyntax((syntax == "regex") ? FilterPattern::Syntax::Regex
+                                                     : FilterPattern::Syntax::Glob);
+        for (const string& pattern : patterns)
+        {
+            string error;
+            if (!filterPattern->addPattern(pattern, &error))
+                throw std::logic_error(
+                    "In a filter-node '" + name + "' invalid pattern '"
+                    + pattern + "'. Detail: " + error);
+        }
+        filter = filterPattern;
+    }
     if (filter.empty())
         return Filter::Ptr();
 
@@ -239,6 +363,7 @@ Filter::Ptr createFilter(const YAML::Node& yfilter)
     filter->setMode((mode == "include") ? Filter::Mode::Include : Filter::Mode::Exclude);
     filter->setFilteringErrors(filteringErrors);
     filter->setFollowThreadContext(followThreadContext);
+    filter->setThreadContextTimeout(threadContextTimeout);
 
     return filter;
 }
@@ -288,6 +413,13 @@ Saver::Ptr createSaver(const YAML::Node& ysaver, const Filter::List& filters,
         maxLineSize = ysaver["max_line_size"].as<int>();
     }
 
+    int utf8Sanitize = -1;
+    if (ysaver["utf8_sanitize"].IsDefined())
+    {
+        checkFiedType("utf8_sanitize", YAML::NodeType::Scalar);
+        utf8Sanitize = ysaver["utf8_sanitize"].as<bool>();
+    }
+
     string file;
 #if defined(_MSC_VER) || defined(__MINGW32__) || defined(__MINGW64__)
     if (ysaver["file_win"].IsDefined())
@@ -346,6 +478,20 @@ Saver::Ptr createSaver(const YAML::Node& ysaver, const Filter::List& filters,
         }
     }
 
+    int async = -1;
+    if (ysaver["async"].IsDefined())
+    {
+        checkFiedType("async", YAML::NodeType::Scalar);
+        async = ysaver["async"].as<bool>();
+    }
+
+    int asyncQueueSize = -1;
+    if (ysaver["async_queue_size"].IsDefined())
+    {
+        checkFiedType("async_queue_size", YAML::NodeType::Scalar);
+        asyncQueueSize = ysaver["async_queue_size"].as<int>();
+    }
+
     bool isContinue = true;
     if (ysaver["continue"].IsDefined())
     {
@@ -353,6 +499,121 @@ Saver::Ptr createSaver(const YAML::Node& ysaver, const Filter::List& filters,
         isContinue = ysaver["continue"].as<bool>();
     }
 
+    int64_t preallocateSize = -1;
+    if (ysaver["preallocate_size"].IsDefined())
+    {
+        checkFiedType("preallocate_size", YAML::NodeType::Scalar);
+        preallocateSize = ysaver["preallocate_size"].as<int64_t>();
+    }
+
+    int64_t rotateSize = -1;
+    if (ysaver["rotate_size"].IsDefined())
+    {
+        checkFiedType("rotate_size", YAML::NodeType::Scalar);
+        rotateSize = ysaver["rotate_size"].as<int64_t>();
+    }
+
+    int rotateInterval = -1;
+    if (ysaver["rotate_interval"].IsDefined())
+    {
+        checkFiedType("rotate_interval", YAML::NodeType::Scalar);
+        rotateInterval = ysaver["rotate_interval"].as<int>();
+    }
+
+    int rotateFiles = -1;
+    if (ysaver["rotate_files"].IsDefined())
+    {
+        checkFiedType("rotate_files", YAML::NodeType::Scalar);
+        rotateFiles = ysaver["rotate_files"].as<int>();
+    }
+
+    string rotateName;
+    if (ysaver["rotate_name"].IsDefined())
+    {
+        checkFiedType("rotate_name", YAML::NodeType::Scalar);
+        rotateName = ysaver["rotate_name"].as<string>();
+        if (!rotateName.empty() && (rotateName.find("%n") == string::npos))
+            throw std::logic_error("In a saver-node a field 'rotate_name' "
+                                   "must contain substitution %n");
+    }
+
+    int rotateCompress = -1;
+    if (ysaver["rotate_compress"].IsDefined())
+    {
+        checkFiedType("rotate_compress", YAML::NodeType::Scalar);
+        rotateCompress = ysaver["rotate_compress"].as<bool>();
+#ifndef LOGGER_USE_ZLIB
+        if (rotateCompress > 0)
+            throw std::logic_error("In a saver-node a field 'rotate_compress' "
+                                   "requires the logger built with LOGGER_USE_ZLIB");
+#endif
+    }
+
+    int asyncWrite = -1;
+    if (ysaver["async_write"].IsDefined())
+    {
+        checkFiedType("async_write", YAML::NodeType::Scalar);
+        asyncWrite = ysaver["async_write"].as<bool>();
+#ifndef LOGGER_USE_IO_SERVICE
+        if (asyncWrite > 0)
+            throw std::logic_error("In a saver-node a field 'async_write' "
+                                   "requires the logger built with LOGGER_USE_IO_SERVICE");
+#endif
+    }
+
+    string asyncWriteBackend;
+    if (ysaver["async_write_backend"].IsDefined())
+    {
+        checkFiedType("async_write_backend", YAML::NodeType::Scalar);
+        asyncWriteBackend = ysaver["async_write_backend"].as<string>();
+        if (asyncWriteBackend != "thread" && asyncWriteBackend != "io_uring")
+            throw std::logic_error("In a saver-node a field 'async_write_backend' "
+                                   "can take the values: 'thread' or 'io_uring'");
+    }
+
+    string format = "text";
+    if (ysaver["format"].IsDefined())
+    {
+        checkFiedType("format", YAML::NodeType::Scalar);
+        format = ysaver["format"].as<string>();
+        if (format != "text" && format != "json" && format != "binary")
+            throw std::logic_error("In a saver-node a field 'format' has "
+                                   "unsupported value '" + format + "'");
+    }
+
+    int binaryCompress = -1;
+    if (ysaver["binary_compress"].IsDefined())
+    {
+        checkFiedType("binary_compress", YAML::NodeType::Scalar);
+        binaryCompress = ysaver["binary_compress"].as<bool>();
+#ifndef LOGGER_USE_ZLIB
+        if (binaryCompress > 0)
+            throw std::logic_error("In a saver-node a field 'binary_compress' "
+                                   "requires the logger built with LOGGER_USE_ZLIB");
+#endif
+    }
+
+    int64_t indexInterval = -1;
+    if (ysaver["index_interval"].IsDefined())
+    {
+        checkFiedType("index_interval", YAML::NodeType::Scalar);
+        indexInterval = ysaver["index_interval"].as<int64_t>();
+    }
+
+    bool mmap = false;
+    if (ysaver["mmap"].IsDefined())
+    {
+        checkFiedType("mmap", YAML::NodeType::Scalar);
+        mmap = ysaver["mmap"].as<bool>();
+    }
+
+    int64_t mmapChunkSize = -1;
+    if (ysaver["mmap_chunk_size"].IsDefined())
+    {
+        checkFiedType("mmap_chunk_size", YAML::NodeType::Scalar);
+        mmapChunkSize = ysaver["mmap_chunk_size"].as<int64_t>();
+    }
+
     list<string> filterNames;
     if (ysaver["filters"].IsDefined())
     {
@@ -363,9 +624,35 @@ Saver::Ptr createSaver(const YAML::Node& ysaver, const Filter::List& filters,
     }
 
     Level level = levelFromString(logLevel);
-    Saver::Ptr saver = (file == "stdout")
-                       ? Saver::Ptr(new SaverStdOut(name, level, false))
-                       : Saver::Ptr(new SaverFile(name, file, level, isContinue));
+    Saver::Ptr saver;
+    if (file == "stdout")
+    {
+        saver = Saver::Ptr(new SaverStdOut(name, level, false));
+    }
+#if !defined(_MSC_VER) && !defined(__MINGW32__) && !defined(__MINGW64__)
+    else if (mmap)
+    {
+        SaverMmap* msaver = new SaverMmap(name, file, level, isContinue);
+        if (mmapChunkSize > 0)
+            msaver->setMapChunkSize(size_t(mmapChunkSize));
+        saver = Saver::Ptr(msaver);
+    }
+#endif
+    else if (format == "json")
+    {
+        saver = Saver::Ptr(new SaverJson(name, file, level, isContinue));
+    }
+    else if (format == "binary")
+    {
+        SaverBinary* bsaver = new SaverBinary(name, file, level, isContinue);
+        if (binaryCompress >= 0)
+            bsaver->setCompress(binaryCompress);
+        saver = Saver::Ptr(bsaver);
+    }
+    else
+    {
+        saver = Saver::Ptr(new SaverFile(name, file, level, isContinue));
+    }
 
     if (active >= 0)
         saver->setActive(active);
@@ -373,6 +660,48 @@ Saver::Ptr createSaver(const YAML::Node& ysaver, const Filter::List& filters,
     if (maxLineSize >= 0)
         saver->setMaxLineSize(maxLineSize);
 
+    if (utf8Sanitize >= 0)
+        saver->setUtf8Sanitize(utf8Sanitize);
+
+    if (async >= 0)
+        saver->setAsync(async);
+
+    if (asyncQueueSize >= 0)
+        saver->setAsyncQueueSize(asyncQueueSize);
+
+    if (preallocateSize >= 0)
+        if (SaverFile* fsaver = dynamic_cast<SaverFile*>(saver.get()))
+            fsaver->setPreallocateSize(size_t(preallocateSize));
+
+    if (SaverFile* fsaver = dynamic_cast<SaverFile*>(saver.get()))
+    {
+        if (rotateSize >= 0)
+            fsaver->setRotateSize(uint64_t(rotateSize));
+
+        if (rotateInterval >= 0)
+            fsaver->setRotateInterval(rotateInterval);
+
+        if (rotateFiles > 0)
+            fsaver->setRotateFiles(rotateFiles);
+
+        if (!rotateName.empty())
+            fsaver->setRotateName(rotateName);
+
+        if (rotateCompress >= 0)
+            fsaver->setRotateCompress(rotateCompress);
+
+        if (asyncWrite >= 0)
+            fsaver->setAsyncWrite(asyncWrite);
+
+        if (!asyncWriteBackend.empty())
+            fsaver->setAsyncWriteBackend((asyncWriteBackend == "io_uring")
+                                         ? SaverFile::WriteBackend::IoUring
+                                         : SaverFile::WriteBackend::Thread);
+
+        if (indexInterval >= 0 && format == "text")
+            fsaver->setIndexInterval(size_t(indexInterval));
+    }
+
     saver->setConfigured(true);
 
     for (const string& filterName : filterNames)
@@ -466,6 +795,15 @@ bool loadSavers(const string& confFile, Saver::List& savers,
 
         YAML::Node conf = YAML::LoadFile(confFile);
 
+        const YAML::Node& ylogger = conf["logger"];
+        if (ylogger.IsDefined() && !ylogger.IsNull())
+        {
+            if (!ylogger.IsMap())
+                throw std::logic_error("Logger node must have map type");
+
+            loadLoggerParams(ylogger);
+        }
+
         const YAML::Node& yfilters = conf["filters"];
         Filter::List filters;
         loadFilters(yfilters, filters, confFile);
@@ -508,6 +846,35 @@ bool loadSavers(const string& confFile, Saver::List& savers,
 void printSaversInfo()
 {
     log_info_m << "---";
+
+    { //Block for alog::Line
+        Logger::Metrics metrics = alog::logger().metrics();
+        alog::Line logLine = log_info_m << "Logger metrics : ";
+
+        auto levelCounts = [&logLine](const char* name, const uint64_t (&counts)[Level::Debug2 + 1])
+        {
+            logLine << name << ": [";
+            for (int i = Level::Error; i <= Level::Debug2; ++i)
+            {
+                logLine << levelToString(Level(i)) << ": " << counts[i];
+                if (i != Level::Debug2)
+                    logLine << ", ";
+            }
+            logLine << "]; ";
+        };
+        levelCounts("enqueued",   metrics.enqueued);
+        levelCounts("dispatched", metrics.dispatched);
+        levelCounts("dropped",    metrics.dropped);
+
+        logLine << "queue_depth: " << metrics.queueDepth
+                << "; queue_depth_max: " << metrics.queueDepthMax
+                << "; batch_count: " << metrics.batchCount
+                << "; batch_messages: " << metrics.batchMessages
+                << "; batch_max: " << metrics.batchMax
+                << "; format_time: " << metrics.formatTime << " us"
+                << "; format_time_max: " << metrics.formatTimeMax << " us";
+    }
+
     Saver::List savers = alog::logger().savers();
 
     // Отключаем фильтрацию для default-сейвера
@@ -544,7 +911,28 @@ void printSaversInfo()
         logLine << "name: " << saver->name()
                 << "; active: " << saver->active()
                 << "; level: " << levelToString(saver->level())
-                << "; max_line_size: " << saver->maxLineSize();
+                << "; max_line_size: " << saver->maxLineSize()
+                << "; utf8_sanitize: " << saver->utf8Sanitize();
+
+        if (saver->async())
+            logLine << "; async_queue_size: " << saver->asyncQueueSize()
+                    << "; async_lag: " << saver->asyncLag()
+                    << "; async_dropped: " << saver->asyncDropped();
+
+        // Гистограмма времени записи выводится в виде списка пар
+        // "верхняя граница интервала (мкс): количество"
+        Saver::Metrics metrics = saver->metrics();
+        logLine << "; flush_count: " << metrics.flushCount
+                << "; flush_messages: " << metrics.flushMessages
+                << "; bytes_written: " << metrics.bytesWritten
+                << "; flush_latency_max: " << metrics.latencyMax << " us"
+                << "; flush_latency: [";
+        nextCommaVal = false;
+        for (int i = 0; i < Saver::Metrics::LatencyBuckets; ++i)
+            if (metrics.latency[i])
+                logLine << nextComma() << (uint64_t(1) << (i + 1)) << ": "
+                        << metrics.latency[i];
+        logLine << "]";
 
         Filter::List filters = saver->filters();
         logLine << "; filters: [";
@@ -557,7 +945,34 @@ void printSaversInfo()
         {
             logLine << "; continue: " << fsaver->isContinue();
             logLine << "; file: " << fsaver->filePath();
+            const char* format = "text";
+            if (dynamic_cast<SaverJson*>(saver))
+                format = "json";
+            else if (dynamic_cast<SaverBinary*>(saver))
+                format = "binary";
+            logLine << "; format: " << format;
+            if (SaverBinary* bsaver = dynamic_cast<SaverBinary*>(saver))
+                logLine << "; binary_compress: " << bsaver->compress();
+            logLine << "; preallocate_size: " << fsaver->preallocateSize();
+            logLine << "; rotate_size: " << fsaver->rotateSize();
+            logLine << "; rotate_interval: " << fsaver->rotateInterval();
+            logLine << "; rotate_files: " << fsaver->rotateFiles();
+            logLine << "; rotate_name: " << fsaver->rotateName();
+            logLine << "; rotate_compress: " << fsaver->rotateCompress();
+            logLine << "; async_write: " << fsaver->asyncWrite();
+            logLine << "; async_write_backend: "
+                    << ((fsaver->asyncWriteBackend() == SaverFile::WriteBackend::IoUring)
+                        ? "io_uring" : "thread");
+            logLine << "; index_interval: " << fsaver->indexInterval();
+        }
+#if !defined(_MSC_VER) && !defined(__MINGW32__) && !defined(__MINGW64__)
+        if (SaverMmap* msaver = dynamic_cast<SaverMmap*>(saver))
+        {
+            logLine << "; continue: " << msaver->isContinue();
+            logLine << "; file: " << msaver->filePath();
+            logLine << "; mmap_chunk_size: " << msaver->mapChunkSize();
         }
+#endif
     }
 
     // Составляем список фильтров
@@ -582,7 +997,8 @@ void printSaversInfo()
         logLine << "name: " << filter->name()
                 << "; mode: " << ((filter->mode() == Filter::Mode::Include) ? "include" : "exclude")
                 << "; filtering_errors: " << filter->filteringErrors()
-                << "; follow_thread_context: " << filter->followThreadContext();
+                << "; follow_thread_context: " << filter->followThreadContext()
+                << "; thread_context_timeout: " << filter->threadContextTimeout();
 
         nextCommaVal = false;
         if (FilterModule* modFilter = dynamic_cast<FilterModule*>(filter))
@@ -641,6 +1057,18 @@ void printSaversInfo()
                 logLine << nextComma() << content;
             logLine << "]";
         }
+        else if (FilterPattern* patternFilter = dynamic_cast<FilterPattern*>(filter))
+        {
+            const char* targets[] = {"module", "file", "func", "content"};
+            logLine << "; type: pattern"
+                    << "; target: " << targets[int(patternFilter->target())]
+                    << "; syntax: "
+                    << ((patternFilter->syntax() == FilterPattern::Syntax::Regex) ? "regex" : "glob")
+                    << "; patterns: [";
+            for (const string* pattern : patternFilter->patterns())
+                logLine << nextComma() << pattern;
+            logLine << "]";
+        }
     }
     log_info_m << "...";
 
@@ -43,6 +43,29 @@ using namespace std;
 
 %YAML 1.2 нотация файла конфигурации
 ---
+logger:
+    # Максимальный размер очереди сообщений логгера: количество сообщений
+    # и суммарный размер текста сообщений в байтах.  Значение 0  снимает
+    # ограничение. По умолчанию размер очереди не ограничен
+    queue_max_count: 100000
+    queue_max_bytes: 67108864
+
+    # Политика обработки переполнения очереди:
+    #    block       - поток-производитель ожидает освобождения места в очереди
+    #                  (значение по умолчанию);
+    #    drop_new    - новые сообщения с уровнем ниже overflow_level отбрасыва-
+    #                  ются;
+    #    drop_oldest - в первую очередь отбрасываются самые старые  сообщения
+    #                  уровней debug и debug2
+    overflow_policy: drop_oldest
+
+    # Уровень сообщений для политики drop_new. По умолчанию info
+    overflow_level: info
+
+    # Интервал (в миллисекундах) вывода сводной информации  об  отброшенных
+    # сообщениях. Значение 0 отключает вывод. По умолчанию 10000
+    overflow_report_time: 10000
+
 filters:
     # Наименование фильтра
   - name: filter1
@@ -71,7 +94,14 @@ filters:
     #    thread_id   - по идентификаторам потоков, список потоков задается через
     #                  параметр threads: [];
     #    content     - по контенту сообщения, список элементов по которым  будет
-    #                  выполняться обработка задается через параметр contents:[]
+    #                  выполняться обработка задается через параметр contents:[];
+    #    pattern     - по шаблонам, список шаблонов задается через  параметр
+    #                  patterns: []. Объект сопоставления задается параметром
+    #                  target: module (по умолчанию), file, func  или  content.
+    #                  Синтаксис шаблонов задается параметром syntax: glob  (по
+    #                  умолчанию) или regex. Glob-шаблон должен совпадать со всем
+    #                  именем (пример: Db*, *Handler.cpp), регулярное выражение
+    #                  ищется в любом месте строки (пример: ^Db|Driver$)
     type: module_name
 
     # Режим работы фильтра: include - включающий; exclude - исключающий
@@ -87,6 +117,11 @@ filters:
     # По умолчанию параметр равен false
     follow_thread_context: false
 
+    # Время (в миллисекундах) в течение которого сообщения потока относятся  к
+    # контексту потока после последнего сообщения, прошедшего фильтр. Исполь-
+    # зуется совместно с follow_thread_context. По умолчанию 3000
+    thread_context_timeout: 3000
+
     # Определяет будут ли неименованные модули обрабатываться данным фильтром.
     # По умолчанию неименованные модули не фильтруются (false)
     filtering_noname_modules: false
@@ -114,6 +149,13 @@ filters:
     level: info
     modules: [LaunchDispatcher, LaunchTask, DbDriver]
 
+  - name: filter4
+    type: pattern
+    mode: exclude
+    target: file
+    syntax: glob
+    patterns: ["*Handler.cpp", "db_*.cpp"]
+
 savers:
     # Наименование сейвера. Наименование 'default' зарезервировано за сейвером
     #  по умолчанию. Сейвер по умолчанию можно  переопределить  в  этом  файле
@@ -134,6 +176,10 @@ savers:
     # нуля, то берется значение по умолчанию равное 5000
     max_line_size: -1
 
+    # Проверка текста сообщений на корректность UTF-8. Некорректные последова-
+    # тельности байт заменяются символом U+FFFD. По умолчанию false
+    utf8_sanitize: false
+
     # Список фильтров для данного сейвера
     filters: [filter1]
 
@@ -144,6 +190,89 @@ savers:
     # лог-файл, в противном случае лог-файл будет очищен при создании сейвера
     continue: true
 
+    # Формат лог-файла: text - текстовый формат; json - JSON Lines, каждое со-
+    # общение записывается  отдельной  строкой  как  JSON-объект  (сейвер
+    # SaverJson), структурированные поля сообщения (alog::kv()) записываются
+    # как элементы объекта; binary - компактный бинарный формат (сейвер Saver-
+    # Binary), текст лога извлекается утилитой alog_decode (logger/tools).
+    # По умолчанию text
+    format: text
+
+    # Сжатие блоков бинарного формата (deflate): без сжатия лог-файл меньше
+    # текстового примерно в 2 раза, со сжатием - более чем в 10 раз. Только
+    # для формата binary, требует сборки логгера с макросом LOGGER_USE_ZLIB.
+    # По умолчанию false
+    binary_compress: false
+
+    # Размер блока (в байтах) для предварительного резервирования места  под
+    # лог-файл. Резервирование уменьшает фрагментацию файла при большом потоке
+    # сообщений. Значение 0 - резервирование не выполняется. Параметр исполь-
+    # зуется только в Linux. По умолчанию 0
+    preallocate_size: 0
+
+    # Ротация лог-файла по размеру: максимальный размер лог-файла в  байтах.
+    # Значение 0 - ротация по размеру не выполняется. По умолчанию 0
+    rotate_size: 0
+
+    # Ротация лог-файла по времени: интервал ротации в секундах. Границы  ин-
+    # тервала выравниваются по локальному времени, например, значение  86400
+    # соответствует ротации в полночь. Значение 0 - ротация по времени не вы-
+    # полняется. По умолчанию 0
+    rotate_interval: 0
+
+    # Количество сохраняемых ротированных файлов. По умолчанию 5
+    rotate_files: 5
+
+    # Шаблон имени ротированного файла. Подстановки: %f - полный путь до  лог-
+    # файла; %b - путь без расширения; %e - расширение (с точкой); %n - номер
+    # файла (1 - самый новый). Шаблон должен содержать %n. По умолчанию "%f.%n"
+    rotate_name: "%f.%n"
+
+    # Сжатие ротированных файлов (gzip) в фоновом потоке с пониженным приори-
+    # тетом. Требует сборки логгера с макросом LOGGER_USE_ZLIB. По  умолчанию
+    # false
+    rotate_compress: false
+
+    # Асинхронный режим: запись выполняется в отдельном потоке сейвера, медлен-
+    # ный сейвер не задерживает запись в остальные сейверы. По умолчанию false
+    async: false
+
+    # Максимальное количество сообщений во входной очереди асинхронного сейве-
+    # ра, при переполнении очереди новые сообщения отбрасываются. Значение  0
+    # снимает ограничение. По умолчанию 100000
+    async_queue_size: 100000
+
+    # Асинхронная запись в лог-файл через сервис ввода-вывода (io_uring  в
+    # Linux): поток логгера не ожидает завершения записи. Требует сборки лог-
+    # гера с макросом LOGGER_USE_IO_SERVICE, иначе конфигурация отклоняется.
+    # По умолчанию false
+    async_write: false
+
+    # Механизм асинхронной записи: thread (поток с вызовами pwritev) или
+    # io_uring. Сервис ввода-вывода один на процесс, механизм определяется
+    # первым сейвером, запустившим сервис. При отсутствии io_uring исполь-
+    # зуется thread. По умолчанию thread
+    async_write_backend: thread
+
+    # Разреженный индекс лог-файла (файл с расширением .idx рядом с лог-фай-
+    # лом): через каждые index_interval байт в индекс записывается  смещение,
+    # диапазон времени, количество сообщений по уровням и маска модулей участ-
+    # ка лог-файла. Индекс используется утилитой log_query (logger/tools) для
+    # быстрого поиска сообщений. При ротации индекс переименовывается вместе
+    # с лог-файлом (для сжатых файлов удаляется). Только для формата text.
+    # Значение 0 - индекс не ведется. По умолчанию 0
+    index_interval: 0
+
+    # Запись в файл, отображенный в память (сейвер SaverMmap). Сообщения, пе-
+    # реданные сейверу, сохраняются при аварийном завершении процесса. Файл
+    # имеет служебный заголовок, текст лога извлекается утилитой  mmap_reader
+    # (logger/tools). Параметр не используется в Windows. По умолчанию false
+    mmap: false
+
+    # Размер блока (в байтах), на который увеличивается отображенная в память
+    # область файла. По умолчанию 16777216 (16 MB)
+    mmap_chunk_size: 16777216
+
   - name: saver2
     active: true
     level: debug
@@ -46,10 +46,47 @@ template<typename... Args> class Format
 {
 public:
     Format(const char* descript, Args&&... args)
-        : _args(std::forward<Args>(args)...)
+        : _descript(descript), _args(std::forward<Args>(args)...)
+    {}
+
+    ~Format()
     {
-        _buff = (char*)malloc(strlen(descript) + 1);
-        strcpy(_buff, descript);
+        free(_buff);
+    }
+
+    Format(Format&& f)
+        : _descript(f._descript), _args(std::move(f._args))
+    {}
+
+    Format() = delete;
+    Format(const Format&) = delete;
+    Format& operator= (Format&&) = delete;
+    Format& operator= (const Format&) = delete;
+
+    void init(Line* line)
+    {
+        _line = line;
+    }
+    void build()
+    {
+        if (_line->deferred())
+        {
+            // В режиме отложенного форматирования разбор строки формата выпол-
+            // няется в потоке логгера, см. функцию deferredFormatter()
+            _line->deferredArg(detail::ArgType::FormatBegin, _descript, strlen(_descript));
+            callBuildFunc(_args, index_sequence_for<Args...>());
+            _line->deferredArg(detail::ArgType::FormatEnd, nullptr, 0);
+            return;
+        }
+        splitChunks();
+        callBuildFunc(_args, index_sequence_for<Args...>());
+    }
+
+private:
+    void splitChunks()
+    {
+        _buff = (char*)malloc(strlen(_descript) + 1);
+        strcpy(_buff, _descript);
 
         char* begin = _buff;
         char* item = _buff;
@@ -73,28 +110,6 @@ public:
         _chunks.push_back(begin);
     }
 
-    ~Format()
-    {
-        free(_buff);
-    }
-
-    Format(Format&&) = default;
-
-    Format() = delete;
-    Format(const Format&) = delete;
-    Format& operator= (Format&&) = delete;
-    Format& operator= (const Format&) = delete;
-
-    void init(Line* line)
-    {
-        _line = line;
-    }
-    void build()
-    {
-        callBuildFunc(_args, index_sequence_for<Args...>());
-    }
-
-private:
     // Решение описано тут:
     // https://www.murrayc.com/permalink/2015/12/05/modern-c-variadic-template-parameters-and-tuples/
     template<std::size_t... Is>
@@ -107,6 +122,14 @@ private:
     template<typename T, typename... Ts>
     void buildFunc(T&& t, Ts&&... ts)
     {
+        if (_line->deferred())
+        {
+            _line->deferredArg(detail::ArgType::FormatArg, nullptr, 0);
+            *_line << t;
+            buildFunc(ts...);
+            return;
+        }
+
         bool chunkPrint = false;
         if (!_chunks.empty())
         {
@@ -125,6 +148,9 @@ private:
     }
     void buildFunc()
     {
+        if (_line->deferred())
+            return;
+
         for (size_t i = 0; i < _chunks.size(); ++i)
         {
             const char* chunk = _chunks[i];
@@ -138,6 +164,7 @@ private:
 
 private:
     Line* _line = {0};
+    const char* _descript;
     tuple<Args...> _args;
 
     char* _buff = {0};
@@ -39,6 +39,7 @@
 #include "safe_singleton.h"
 #include "thread/thread_base.h"
 #include "thread/thread_utils.h"
+#include "logger/matchers.h"
 
 #include <cctype>
 #include <ctime>
@@ -50,6 +51,11 @@
 #include <cmath>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 #include <type_traits>
 
 #if __cplusplus >= 201703L
@@ -62,6 +68,11 @@ using namespace std;
 
 class Saver;
 class Logger;
+struct CallSite;
+
+namespace detail {
+struct RenderCache;
+} // namespace detail
 
 // Уровни log-сообщений
 enum Level
@@ -130,13 +141,54 @@ struct Message
     int         line   = {0};
     const char* module = {0};
 
+    // Дескриптор точки логирования, может быть равен nullptr (см. CallSite)
+    const CallSite* site = {nullptr};
+
+    // Числовые идентификаторы наименований модуля, файла и функции  (см.
+    // detail::nameId()). Назначаются в потоке логгера для сообщений с деск-
+    // риптором точки логирования, используются механизмом фильтрации. Зна-
+    // чение 0 - идентификатор не назначен
+    uint32_t    moduleId = {0};
+    uint32_t    fileId   = {0};
+    uint32_t    funcId   = {0};
+
     timespec    timeSpec;
     pid_t       threadId;
     string      str;
 
+    // Признак отложенного форматирования: поле str содержит  не текст сообщения,
+    // а аргументы точки логирования в бинарном виде (см. Logger::deferredFormat).
+    // Преобразование в текст выполняется в потоке логгера
+    bool        deferred = {false};
+
+    // Структурированные поля сообщения (см. alog::kv()) в бинарном виде. Поля
+    // разбираются функцией detail::nextField()
+    string      fields;
+
+    // Значение счетчика TSC в момент создания сообщения (Logger::TimeSource::Tsc).
+    // Преобразование в timeSpec выполняется в потоке логгера
+    uint64_t    tsc = {0};
+
+    // Размер сообщения, учтенный в счетчиках очереди логгера
+    // (см. Logger::queueMaxBytes)
+    uint32_t    queueBytes = {0};
+
+    // Признак того, что сообщение учтено в счетчиках очереди логгера. Для
+    // неограниченной очереди счетчики не используются
+    bool        queueCounted = {false};
+
     Something::Ptr something;
 
+    // Указатель на следующее сообщение, используется  для  организации
+    // lock-free очереди сообщений логгера (см. Logger::addMessage())
+    Message* next = {nullptr};
+
+    // Кэш строк, сформированных для сейверов (см. renderLine()). Создается
+    // при первом обращении и сохраняется при возврате сообщения в пул
+    mutable atomic<detail::RenderCache*> renderCache = {nullptr};
+
     Message() = default;
+    ~Message();
     Message(Message&&) = delete;
     Message(const Message&) = delete;
     Message& operator= (Message&&) = delete;
@@ -145,8 +197,223 @@ struct Message
     bool moduleEqual(const char* module) const
         {return strcmp((this->module ? this->module : ""), module) == 0;}
 };
-typedef lst::List<Message, lst::CompareItemDummy> MessageList;
-typedef simple_ptr<Message> MessagePtr;
+
+/**
+  Вариант оформления строки лог-файла
+*/
+enum class LineLayout
+{
+    Short  = 0, // Только текст сообщения
+    Normal = 1, // prefix1, prefix3, текст сообщения
+    Debug2 = 2, // prefix1, prefix2 (микросекунды), prefix3, текст сообщения
+    Syslog = 3, // prefix3, текст сообщения (без Something::modifyMessage())
+    Text   = 4  // Только текст сообщения без структурированных полей
+};
+
+/**
+  Строка лог-файла, сформированная для сообщения. Строка состоит из фрагмен-
+  тов, ссылающихся на префиксы и текст сообщения, поэтому при записи строки
+  дополнительное копирование данных не требуется. Структурированные поля сооб-
+  щения (кроме варианта LineLayout::Text) выводятся после текста в виде пар
+  key=value. Завершающий перевод строки в строку не входит
+*/
+struct RenderedLine
+{
+    static const int MaxParts = 6;
+
+    const char* parts[MaxParts];
+    size_t sizes[MaxParts];
+    int    count = {0};
+    size_t size = {0}; // Общий размер строки
+};
+
+// Возвращает строку для сообщения m в варианте оформления layout, текст со-
+// общения вместе со структурированными полями обрезается до maxLineSize байт
+// (значение меньше либо равное 0 - без ограничения, префикс строки не учиты-
+// вается). Вызов Something::modifyMessage() и обрезка текста выполняются
+// один раз, сформированная строка кэшируется в сообщении и используется всеми
+// сейверами, получившими сообщение, в том числе асинхронными. Ссылка действи-
+// тельна до возврата сообщения в пул. Для варианта LineLayout::Syslog
+// Something::modifyMessage() не вызывается
+// Если параметр utf8Sanitize = TRUE, то некорректные UTF-8 последовательности
+// в тексте сообщения заменяются символом U+FFFD (см. Saver::utf8Sanitize())
+const RenderedLine& renderLine(const Message& m, LineLayout layout, int maxLineSize,
+                               bool utf8Sanitize = false);
+
+namespace detail {
+
+// Типы наименований, для каждого типа используется отдельная нумерация
+enum class NameType
+{
+    Module = 0,
+    File   = 1,
+    Func   = 2
+};
+
+// Возвращает числовой идентификатор  наименования  (интернирование  строк).
+// Идентификаторы назначаются последовательно начиная с 1, одинаковые наимено-
+// вания получают одинаковые идентификаторы. Для  name == nullptr  возвращается
+// идентификатор пустой строки. Функция потокобезопасна
+uint32_t nameId(NameType, const char* name);
+
+// Назначает сообщению идентификаторы модуля, файла и функции из дескриптора
+// точки логирования. Сообщениям без дескриптора идентификаторы не назначают-
+// ся, при необходимости они вычисляются фильтрами
+void assignNameIds(Message&);
+
+/**
+  Множество числовых идентификаторов в виде битовой карты. Используется для
+  проверки принадлежности наименования фильтру
+*/
+class IdSet
+{
+public:
+    void add(uint32_t id)
+    {
+        size_t word = id >> 6;
+        if (word >= _bits.size())
+            _bits.resize(word + 1, 0);
+        _bits[word] |= (uint64_t(1) << (id & 63));
+    }
+    bool contains(uint32_t id) const
+    {
+        size_t word = id >> 6;
+        return (word < _bits.size()) && ((_bits[word] >> (id & 63)) & 1);
+    }
+
+private:
+    vector<uint64_t> _bits;
+};
+
+/**
+  Таблица идентификаторов потоков для фильтрации по контексту потока. Хеш-
+  таблица с открытой адресацией хранит для каждого потока время  последнего
+  сообщения. Устаревание записей реализовано через два поколения таблиц:
+  новые записи попадают в текущее поколение, по истечении таймаута текущее
+  поколение становится предыдущим, а предыдущее очищается. Таким образом
+  запись живет не дольше двух таймаутов, при этом вставка, поиск и удаление
+  устаревших записей выполняются за амортизированное O(1)
+*/
+class ThreadContextTable
+{
+public:
+    // Таймаут в миллисекундах
+    void setTimeout(int msec) {_timeout = int64_t(msec) * 1000000;}
+
+    // Запоминает время (наносекунды) последнего сообщения для потока
+    void insert(pid_t tid, int64_t time);
+
+    // Возвращает TRUE если для потока было сообщение, и с момента этого
+    // сообщения прошло не больше таймаута
+    bool contains(pid_t tid, int64_t time);
+
+    // Смена поколений по текущему времени
+    void expire(int64_t time);
+
+private:
+    struct Slot
+    {
+        pid_t   tid;  // 0 - свободная ячейка
+        int64_t time;
+    };
+    struct Table
+    {
+        vector<Slot> slots;
+        size_t count = {0};
+    };
+
+    void rotate(int64_t time);
+    static Slot* find(Table&, pid_t tid);
+
+    Table   _tables[2];
+    int     _current = {0};
+    int64_t _generationStart = {0};
+    int64_t _timeout = {3000000000LL};
+};
+
+} // namespace detail
+
+/**
+  Дескриптор точки логирования. Создается статически для каждой точки логиро-
+  вания (см. макросы log_error ... log_debug2), инициализируется при первом
+  обращении. Адрес дескриптора может использоваться как уникальный идентифи-
+  катор точки логирования.
+  Дескриптор хранит заранее сформированный фрагмент префикса сообщения вида
+  " [file:line module] ", это позволяет не выполнять форматирование местопо-
+  ложения для каждого сообщения (см. prefixFormatter3())
+*/
+struct CallSite
+{
+    CallSite(Level level, const char* file, const char* func, int line,
+             const char* module)
+        : level(level), file(file), func(func), line(line), module(module)
+    {}
+
+    const Level       level;
+    const char* const file;
+    const char* const func;
+    const int         line;
+    const char* const module;
+
+    // Возвращает фрагмент префикса сообщения. Фрагмент  формируется  при
+    // первом вызове функции. Если фрагмент в данный момент формируется в
+    // другом потоке, то функция возвращает nullptr
+    const char* fragment(size_t& size) const;
+
+    // Возвращают идентификаторы наименований (см. detail::nameId()). Иденти-
+    // фикаторы назначаются при первом вызове
+    uint32_t moduleId() const;
+    uint32_t fileId() const;
+    uint32_t funcId() const;
+
+private:
+    CallSite(CallSite&&) = delete;
+    CallSite(const CallSite&) = delete;
+    CallSite& operator= (CallSite&&) = delete;
+    CallSite& operator= (const CallSite&) = delete;
+
+    // Состояние фрагмента: 0 - не сформирован, 1 - формируется, 2 - готов
+    mutable atomic<int> _fragmentState = {0};
+    mutable char        _fragment[sizeof(Message::prefix3)];
+    mutable size_t      _fragmentSize = {0};
+
+    mutable atomic<uint32_t> _moduleId = {0};
+    mutable atomic<uint32_t> _fileId = {0};
+    mutable atomic<uint32_t> _funcId = {0};
+};
+
+/**
+  Пул объектов Message. Используется для  исключения  обращений  к глобальному
+  распределителю памяти при создании и разрушении лог-сообщений.
+  Каждый поток имеет собственный кэш объектов, обмен объектами между  потоками
+  выполняется пакетами через общий список. Типичная схема  работы:  потоки-про-
+  изводители забирают пакеты свободных сообщений, поток  логгера  после  записи
+  сообщений возвращает их в общий список так же пакетами.
+  Буферы сообщения (в том числе емкость строки Message::str) сохраняются между
+  использованиями объекта. Объем памяти, удерживаемой общим списком, ограни-
+  чен (16 Мб), длинные буферы строк при передаче сообщений в общий список
+  освобождаются
+*/
+struct MessagePool
+{
+    static Message* create();
+    static void destroy(Message*);
+};
+
+/**
+  Распределитель памяти для MessagePtr и MessageList, объекты Message создаются
+  и разрушаются через MessagePool
+*/
+template<typename T> struct MessageAlloc
+{
+    static_assert(std::is_same<T, Message>::value, "Type T must be Message");
+
+    static T* create() {return MessagePool::create();}
+    static void destroy(T* x) {MessagePool::destroy(x);}
+};
+
+typedef lst::List<Message, lst::CompareItemDummy, MessageAlloc<Message>> MessageList;
+typedef simple_ptr<Message, MessageAlloc> MessagePtr;
 
 struct StringCompare
 {
@@ -225,6 +492,12 @@ public:
     virtual bool followThreadContext() const;
     void setFollowThreadContext(bool);
 
+    // Время (в миллисекундах) в течение которого сообщения потока считаются
+    // относящимися к контексту потока после последнего сообщения, прошедшего
+    // фильтр. По умолчанию 3000 мс
+    int threadContextTimeout() const {return _threadContextTimeout;}
+    void setThreadContextTimeout(int msec);
+
     enum class Check
     {
         NoLock    = -1, // Фильтр не заперт
@@ -239,8 +512,16 @@ public:
     // Возвращает статус фильта: заперт/не заперт
     bool locked() const {return _locked;}
 
-    // Запирает фильтр
-    void lock() {_locked = true;}
+    // Запирает фильтр. Перед запиранием критерии фильтрации компилируются
+    // во внутреннее представление (см. compile())
+    void lock();
+
+protected:
+    // Преобразует критерии фильтрации во внутреннее представление, удобное
+    // для быстрой проверки сообщений (например, наименования  модулей  пре-
+    // образуются в битовую карту идентификаторов). Вызывается один раз при
+    // запирании фильтра
+    virtual void compile() {}
 
 private:
     Filter(Filter&&) = delete;
@@ -250,8 +531,8 @@ private:
 
     virtual bool checkImpl(const Message&) const = 0;
 
-    // Удаляет идентификаторы потоков из списка _threadContextIds. Удаление
-    // происходит по истечении временного интервала в 3 секунды
+    // Удаляет идентификаторы потоков из таблицы _threadContextIds. Удаление
+    // происходит по истечении таймаута threadContextTimeout
     void removeIdsTimeoutThreads();
 
 private:
@@ -260,10 +541,13 @@ private:
     bool   _locked = {false};
     bool   _filteringErrors = {false};
     bool   _followThreadContext = {false};
+    int    _threadContextTimeout = {3000};
 
-    // Список идентификаторов потоков, используется для фильтрации сообщений
-    // по контексту потока
-    mutable map<pid_t, timespec> _threadContextIds;
+    // Таблица идентификаторов потоков, используется для фильтрации сообщений
+    // по контексту потока. Фильтр может быть назначен нескольким асинхронным
+    // сейверам, поэтому доступ к таблице защищен блокировкой
+    mutable detail::ThreadContextTable _threadContextIds;
+    mutable atomic_flag _threadContextLock = ATOMIC_FLAG_INIT;
 
     friend class Saver;
 };
@@ -286,9 +570,16 @@ public:
     bool filteringNoNameModules() const {return _filteringNoNameModules;}
     void setFilteringNoNameModules(bool val);
 
+protected:
+    void compile() override;
+
+    // Возвращает TRUE если модуль сообщения входит в список модулей фильтра
+    bool containsModule(const Message&) const;
+
 private:
     bool checkImpl(const Message&) const override;
     StringList _modules;
+    detail::IdSet _moduleIds;
     bool _filteringNoNameModules = {false};
 };
 
@@ -338,9 +629,15 @@ public:
     // Добавляет файлы на которые будет распространяться действие фильтра
     void addFile(const string& name);
 
+protected:
+    void compile() override;
+
 private:
     bool checkImpl(const Message&) const override;
     Files _files;
+
+    // Таблица поиска: индекс - идентификатор файла
+    vector<const FileLine*> _fileIndex;
 };
 
 /**
@@ -356,9 +653,13 @@ public:
     // Добавляет функции на которые будет распространяться действие фильтра
     void addFunc(const string& name);
 
+protected:
+    void compile() override;
+
 private:
     bool checkImpl(const Message&) const override;
     StringList _funcs;
+    detail::IdSet _funcIds;
 };
 
 /**
@@ -394,9 +695,73 @@ public:
     // этого фильтра
     void addContent(const string& content);
 
+protected:
+    void compile() override;
+
 private:
     bool checkImpl(const Message&) const override;
     StringList _contents;
+    detail::MultiMatcher _matcher;
+};
+
+/**
+  Фильтрация по шаблонам (glob или регулярные выражения). Шаблоны применяются
+  к имени модуля, имени файла, имени функции или к тексту сообщения. Шаблоны
+  компилируются один раз при запирании фильтра. Для имен модулей, файлов  и
+  функций результат сопоставления запоминается для каждого идентификатора
+  наименования (см. detail::nameId()), поэтому повторная проверка сводится
+  к поиску в таблице
+*/
+class FilterPattern : public Filter
+{
+public:
+    typedef clife_ptr<FilterPattern> Ptr;
+    typedef detail::PatternMatcher::Syntax Syntax;
+
+    // Объект сопоставления
+    enum class Target
+    {
+        Module  = 0,
+        File    = 1,
+        Func    = 2,
+        Content = 3
+    };
+
+    Target target() const {return _target;}
+    void setTarget(Target);
+
+    // Синтаксис шаблонов, по умолчанию Syntax::Glob. Синтаксис должен быть
+    // задан до добавления шаблонов
+    Syntax syntax() const {return _syntax;}
+    void setSyntax(Syntax);
+
+    // Параметр имеет тот же смысл, что и для FilterModule. Используется только
+    // для Target::Module
+    bool filteringNoNameModules() const {return _filteringNoNameModules;}
+    void setFilteringNoNameModules(bool val);
+
+    const StringList& patterns() const {return _patterns;}
+
+    // Добавляет шаблон. Если шаблон содержит синтаксическую ошибку, то он не
+    // добавляется, функция возвращает FALSE
+    bool addPattern(const string& pattern, string* error = nullptr);
+
+protected:
+    void compile() override;
+
+private:
+    bool checkImpl(const Message&) const override;
+
+    Target _target = {Target::Module};
+    Syntax _syntax = {Syntax::Glob};
+    bool _filteringNoNameModules = {false};
+    StringList _patterns;
+    detail::PatternMatcher _matcher;
+
+    // Результаты сопоставления, индекс - идентификатор наименования.
+    // Значения: 0 - не вычислено, 1 - нет совпадения, 2 - есть совпадение
+    mutable vector<uint8_t> _cache;
+    mutable atomic_flag _cacheLock = ATOMIC_FLAG_INIT;
 };
 
 /**
@@ -424,20 +789,74 @@ public:
     Level level() const {return _level;}
     void  setLevel(Level);
 
-    // Устанавливает ограничение на максимальную длину строки сообщения.
-    // Длина строки не ограничивается если значение меньше либо равно 0.
+    // Устанавливает ограничение на максимальную длину строки сообщения (текст
+    // сообщения вместе со структурированными полями, см. alog::kv()). Длина
+    // строки не ограничивается если значение меньше либо равно 0.
     // Значение по умолчанию 5000
     int  maxLineSize() const {return _maxLineSize;}
     void setMaxLineSize(int);
 
+    // Проверка текста сообщений на корректность UTF-8, некорректные последо-
+    // вательности заменяются символом U+FFFD. Проверка выполняется один раз
+    // для сообщения, независимо от количества сейверов. По умолчанию FALSE
+    bool utf8Sanitize() const {return _utf8Sanitize;}
+    void setUtf8Sanitize(bool);
+
     // Признак определяет, что настройки сейвера взяты из конфигурационного
     // файла
     bool configured() const {return _configured;}
     void setConfigured(bool);
 
+    // Асинхронный режим записи. В этом режиме сообщения записываются не  в по-
+    // токе логгера, а в отдельном потоке сейвера, таким образом медленный сей-
+    // вер (например, лог-файл на сетевом диске) не задерживает запись  сообще-
+    // ний в остальные сейверы. По умолчанию режим выключен
+    bool async() const {return _async;}
+    void setAsync(bool);
+
+    // Максимальное количество сообщений во входной очереди асинхронного  сей-
+    // вера. Если очередь заполнена, то новый пакет сообщений отбрасывается.
+    // Значение 0 снимает ограничение. Значение по умолчанию 100000
+    int  asyncQueueSize() const {return _asyncQueueSize;}
+    void setAsyncQueueSize(int);
+
+    // Количество сообщений, ожидающих записи в асинхронном режиме (отставание
+    // сейвера от потока логгера)
+    uint64_t asyncLag() const {return _asyncLag;}
+
+    // Количество сообщений, отброшенных из-за переполнения входной очереди
+    // асинхронного сейвера
+    uint64_t asyncDropped() const {return _asyncDropped;}
+
     // Выполняет запись буфера сообщений
     void flush(const MessageList&);
 
+    // Если функция возвращает TRUE, то сообщения передаются сейверу сразу
+    // после форматирования, без накопления в течение Logger::flushTime().
+    // Используется сейверами, запись в которые не требует системных вызовов
+    virtual bool flushImmediately() const {return false;}
+
+    /**
+      Метрики сейвера
+    */
+    struct Metrics
+    {
+        // Количество интервалов гистограммы времени записи. Интервал i соот-
+        // ветствует времени записи [2^i, 2^(i+1)) микросекунд, последний ин-
+        // тервал включает все большие значения
+        static const int LatencyBuckets = 24;
+
+        uint64_t flushCount    = {0}; // Количество вызовов flush()
+        uint64_t flushMessages = {0}; // Количество сообщений, переданных
+                                      // на запись
+        uint64_t bytesWritten  = {0}; // Количество записанных байт
+        uint64_t latencyMax    = {0}; // Максимальное время записи (мкс)
+        uint64_t latency[LatencyBuckets] = {0}; // Гистограмма времени записи
+    };
+
+    // Возвращает снимок метрик сейвера
+    Metrics metrics() const;
+
     // Возвращает snapshot-список фильтров
     Filter::List filters() const;
 
@@ -473,6 +892,10 @@ protected:
 
     void removeIdsTimeoutThreads();
 
+    // Учитывает в метриках сейвера количество записанных байт
+    void addBytesWritten(uint64_t val)
+        {_bytesWritten.fetch_add(val, std::memory_order_relaxed);}
+
 private:
     Saver() = delete;
     Saver(Saver&&) = delete;
@@ -487,11 +910,25 @@ private:
     Level  _level = {Error};
     int    _maxLineSize = {5000};
     bool   _configured = {false};
+    bool   _utf8Sanitize = {false};
+    bool   _async = {false};
+    int    _asyncQueueSize = {100000};
+
+    atomic<uint64_t> _asyncLag = {0};
+    atomic<uint64_t> _asyncDropped = {0};
+
+    // Метрики (см. Metrics)
+    atomic<uint64_t> _flushCount = {0};
+    atomic<uint64_t> _flushMessages = {0};
+    atomic<uint64_t> _bytesWritten = {0};
+    atomic<uint64_t> _latencyMax = {0};
+    atomic<uint64_t> _latency[Metrics::LatencyBuckets] = {};
 
     Filter::List  _filters;
     atomic_bool _filtersActive = {true};
     mutable atomic_flag _filtersLock = ATOMIC_FLAG_INIT;
 
+    friend class Logger;
     friend class SaverStdOut;
     friend class SaverStdErr;
 };
@@ -535,6 +972,7 @@ public:
 
     SaverFile(const string& name, const string& filePath, Level level = Error,
               bool isContinue = true);
+    ~SaverFile();
 
     // Возвращает полный путь до лог-файла
     string filePath() const {return _filePath;}
@@ -544,17 +982,450 @@ public:
     // при создании сейвера
     bool isContinue() const {return _isContinue;}
 
+    // Размер блока (в байтах) для предварительного резервирования места под
+    // лог-файл (fallocate). Резервирование уменьшает фрагментацию файла при
+    // большом потоке сообщений. Значение 0 - резервирование не выполняется.
+    // Параметр используется только в Linux. По умолчанию 0
+    size_t preallocateSize() const {return _preallocateSize;}
+    void setPreallocateSize(size_t);
+
+    // Ротация лог-файла. Лог-файл ротируется при превышении размера rotateSize
+    // (в байтах) и/или по истечении интервала rotateInterval (в секундах, гра-
+    // ницы интервала выравниваются по локальному времени, например, интервал
+    // 86400 соответствует ротации в полночь). Значение 0 отключает соответст-
+    // вующий критерий. По умолчанию ротация выключена
+    uint64_t rotateSize() const {return _rotateSize;}
+    void setRotateSize(uint64_t);
+
+    int rotateInterval() const {return _rotateInterval;}
+    void setRotateInterval(int);
+
+    // Количество сохраняемых ротированных файлов, по умолчанию 5
+    int rotateFiles() const {return _rotateFiles;}
+    void setRotateFiles(int);
+
+    // Шаблон имени ротированного файла. Подстановки: %f - полный путь до лог-
+    // файла; %b - путь без расширения; %e - расширение (с точкой); %n - номер
+    // файла (1 - самый новый). Шаблон должен содержать %n. По умолчанию "%f.%n"
+    const string& rotateName() const {return _rotateName;}
+    void setRotateName(const string&);
+
+    // Сжатие ротированных файлов (gzip, к имени файла добавляется  ".gz").
+    // Сжатие выполняется в фоновом потоке с пониженным приоритетом. Доступно
+    // при сборке с макросом LOGGER_USE_ZLIB, иначе значение параметра оста-
+    // ется FALSE (конфигурация с rotate_compress: true отклоняется).
+    // По умолчанию FALSE
+    bool rotateCompress() const {return _rotateCompress;}
+    void setRotateCompress(bool);
+
+    // Асинхронная запись через сервис ввода-вывода trd::IoService (io_uring
+    // в Linux). Поток логгера только передает пакет сообщений сервису и  не
+    // ожидает завершения записи. Доступно при сборке с макросом LOGGER_USE_-
+    // IO_SERVICE, иначе значение параметра остается FALSE (конфигурация  с
+    // async_write: true отклоняется). По умолчанию FALSE
+    bool asyncWrite() const {return _asyncWrite;}
+    void setAsyncWrite(bool);
+
+    // Механизм выполнения асинхронной записи (см. asyncWrite)
+    enum class WriteBackend
+    {
+        Thread  = 0, // Поток с вызовами pwritev()
+        IoUring = 1  // io_uring (только Linux)
+    };
+
+    // Сервис ввода-вывода один на процесс, поэтому механизм определяется
+    // сейвером, первым запустившим сервис. Для больших объемов  записи  ме-
+    // ханизм Thread быстрее (см. tests/io_service_speed), поэтому по умол-
+    // чанию используется он
+    WriteBackend asyncWriteBackend() const {return _asyncWriteBackend;}
+    void setAsyncWriteBackend(WriteBackend);
+
+    // Разреженный индекс лог-файла. Индекс записывается в файл filePath + ".idx",
+    // каждая запись индекса (IndexEntry) описывает участок лог-файла размером
+    // не менее indexInterval байт: смещение, диапазон времени сообщений, коли-
+    // чество сообщений каждого уровня и маску модулей. Индекс позволяет  ути-
+    // литам (см. logger/tools/log_query) читать только участки  лог-файла,
+    // содержащие сообщения нужного интервала времени, уровня или модуля. При
+    // ротации индекс переименовывается вместе с лог-файлом (<имя>.idx  рядом
+    // с ротированным файлом), для сжатых файлов индекс удаляется. Использу-
+    // ется только для текстового формата (SaverJson, SaverBinary
+    // индекс не записывают). Значение 0 - индекс не ведется. По умолчанию 0
+    size_t indexInterval() const {return _indexInterval;}
+    void setIndexInterval(size_t);
+
+    struct IndexHeader
+    {
+        static const uint32_t Version = 1;
+
+        char     magic[8]; // "ALOGIDX1"
+        uint32_t version;
+        uint32_t interval;
+    };
+
+    struct IndexEntry
+    {
+        uint64_t offset;     // Смещение участка в лог-файле
+        uint64_t size;       // Размер участка
+        int64_t  minTime;    // Диапазон времени сообщений участка
+        int64_t  maxTime;    // (наносекунды от начала эпохи)
+        uint32_t levels[8];  // Количество сообщений по уровням (индекс - Level)
+        uint64_t moduleMask; // Маска модулей (см. indexModuleBit())
+    };
+
+    // Возвращает бит маски модулей для модуля с наименованием module (nullptr
+    // или пустая строка - сообщение без модуля)
+    static uint64_t indexModuleBit(const char* module);
+
+    // Читает записи индекса из файла indexPath. При ошибке возвращает FALSE
+    // и описание ошибки в параметре error
+    static bool readIndex(const string& indexPath, vector<IndexEntry>& entries,
+                          string& error);
+
+protected:
+    void flushImpl(const MessageList&) override;
+
+    // Фрагмент данных для записи в лог-файл
+    struct Chunk
+    {
+        const char* data;
+        size_t size;
+    };
+
+    // Формирует строки лог-файла для сообщений пакета,  не отброшенных  фильт-
+    // рами. Фрагменты строк добавляются в chunks без копирования данных, пара-
+    // метр size увеличивается на размер добавленных фрагментов. Фрагменты долж-
+    // ны оставаться действительными до завершения flushImpl(). Производные
+    // классы переопределяют функцию для изменения формата лог-файла
+    virtual void render(const MessageList&, const Filter::List&,
+                        vector<Chunk>& chunks, uint64_t& size);
+
+    // Открывает лог-файл. Дескриптор файла остается открытым между вызовами
+    // flushImpl(). Если лог-файл был переименован или удален  (ротация  лог-
+    // файлов внешней утилитой), то файл открывается заново
+    bool openFile();
+
+    // Закрывает лог-файл. Функция onClosed вызывается после фактического за-
+    // крытия дескриптора, при асинхронной записи - после завершения записи
+    // всех переданных сервису данных (в потоке сервиса ввода-вывода)
+    void closeFile(function<void()> onClosed = nullptr);
+
+    // Проверяет необходимость ротации перед записью size байт
+    bool rotateNeeded(uint64_t size, time_t now) const;
+
+    // Выполняет ротацию: текущий лог-файл переименовывается во  временный
+    // файл и открывается новый лог-файл. Сдвиг номеров ротированных файлов,
+    // удаление старых файлов и сжатие выполняются в фоновом потоке
+    void rotate(time_t now);
+
+    // Вычисляет время следующей ротации по интервалу
+    time_t nextRotateTime(time_t now) const;
+
+    // Открывает файл индекса для текущего лог-файла. Если индекс не соответ-
+    // ствует лог-файлу, то индекс создается заново
+    void openIndex();
+    void closeIndex();
+
+    // Добавляет в индекс сообщения, учтенные функцией render(), offset - сме-
+    // щение в лог-файле, с которого сообщения были записаны
+    void indexMessages(uint64_t offset);
+
+    // Записывает в файл индекса текущий участок
+    void writeIndexEntry();
+
+private:
+    string _filePath;
+    bool   _isContinue = {true};
+
+    int      _fd = {-1};
+    uint64_t _fileDev = {0};
+    uint64_t _fileIno = {0};
+
+    size_t   _preallocateSize = {0};
+    int64_t  _preallocated = {0}; // Граница зарезервированного места
+
+    uint64_t _fileSize = {0};
+    uint64_t _rotateSize = {0};
+    int      _rotateInterval = {0};
+    int      _rotateFiles = {5};
+    string   _rotateName = {"%f.%n"};
+    bool     _rotateCompress = {false};
+    time_t   _rotateTime = {0};  // Время следующей ротации по интервалу
+    uint32_t _rotateCount = {0}; // Счетчик для имен временных файлов
+    bool     _rotateTempChecked = {false}; // Выполнен поиск временных файлов
+
+    bool _asyncWrite = {false};
+    WriteBackend _asyncWriteBackend = {WriteBackend::Thread};
+    int  _ioFileId = {-1}; // Идентификатор файла в trd::IoService
+
+    // Параметры сообщения для индекса, заполняются функцией render()
+    struct IndexMark
+    {
+        int64_t  time;
+        uint64_t moduleBit;
+        uint32_t size;
+        Level    level;
+    };
+
+    size_t _indexInterval = {0};
+    int    _indexFd = {-1};
+    IndexEntry _indexEntry = {}; // Текущий участок, size == 0 - участок пуст
+    vector<IndexMark> _indexMarks;
+};
+
+/**
+  Вывод в файл в формате JSON Lines: каждое сообщение записывается в отдель-
+  ной строке как JSON-объект вида
+    {"time":1760000000.123456,"level":"INFO","tid":1234,"file":"main.cpp",
+     "line":10,"func":"main","module":"Net","msg":"...","user":"alice"}
+  Структурированные поля сообщения (см. alog::kv()) записываются как элемен-
+  ты объекта после поля "msg". Если ключ поля (без ведущих символов '_')
+  совпадает с наименованием основного поля (time, level, tid, file, line,
+  func, module, msg), то к нему добавляется префикс '_' ("msg" -> "_msg",
+  "_msg" -> "__msg"), поэтому ключи в объекте не повторяются.
+  Значение "time" - время в секундах от начала эпохи.
+  Сериализация выполняется во внутренний буфер сейвера,  емкость  которого
+  сохраняется между вызовами. Некорректные UTF-8 последовательности в стро-
+  ках всегда заменяются символом U+FFFD. Ротация, резервирование места и
+  асинхронная запись выполняются так же, как для SaverFile
+*/
+class SaverJson : public SaverFile
+{
+public:
+    typedef clife_ptr<SaverJson> Ptr;
+
+    SaverJson(const string& name, const string& filePath, Level level = Error,
+              bool isContinue = true);
+
+protected:
+    void render(const MessageList&, const Filter::List&,
+                vector<Chunk>& chunks, uint64_t& size) override;
+
+private:
+    string _buff;
+    string _sanitized; // Временный буфер для исправления UTF-8 строк
+};
+
+/**
+  Вывод в файл в компактном бинарном формате. Каждый пакет  сообщений  запи-
+  сывается одним блоком: заголовок блока (BlockHeader), таблица строк, записи
+  сообщений. Таблица строк содержит наименования файлов, функций и модулей,
+  используемые в блоке, записи ссылаются на строки по номеру. Время сообще-
+  ния записывается как смещение (в наносекундах) от времени предыдущей записи,
+  для первой записи - от базового времени блока.
+  Целые числа записываются в формате varint. Контрольная сумма (CRC-32) вы-
+  числяется для всего блока за исключением заголовка. Блок не зависит от пре-
+  дыдущих блоков, поэтому поврежденный блок не мешает чтению последующих.
+  Для преобразования лог-файла в текстовый вид используется утилита
+  logger/tools/alog_decode.
+  Без сжатия размер лог-файла меньше текстового примерно в 2 раза (текст со-
+  общений хранится как есть). Записи блока могут сжиматься (deflate, см.
+  compress()), для типичных логов размер при этом уменьшается более чем  в
+  10 раз по сравнению с текстовым.
+  Данные записываются в порядке байт процессора (little-endian для x86/ARM)
+*/
+class SaverBinary : public SaverFile
+{
+public:
+    typedef clife_ptr<SaverBinary> Ptr;
+
+    struct BlockHeader
+    {
+        static const uint32_t Size = 32;
+
+        char     magic[4]; // "ALB1"
+        uint32_t size;     // Размер данных блока без учета заголовка
+        uint32_t crc;      // CRC-32 данных блока
+        uint32_t count;    // Количество записей в блоке
+        uint8_t  level;    // Уровень логирования сейвера
+        uint8_t  flags;    // Флаги блока (см. Flags)
+        uint8_t  reserved[6];
+        int64_t  baseTime; // Базовое время блока (наносекунды от начала эпохи)
+
+        enum Flags : uint8_t
+        {
+            // Записи блока сжаты (deflate). За таблицей строк следует размер
+            // несжатых записей (varint) и сжатые данные. CRC-32 вычисляется
+            // для сжатых данных
+            Compressed = 0x01
+        };
+    };
+
+    enum class ReadResult
+    {
+        Ok          = 0,
+        Incomplete  = 1, // Данных недостаточно для чтения блока
+        Corrupted   = 2, // Блок поврежден
+        Unsupported = 3  // Блок сжат, а сборка выполнена без LOGGER_USE_ZLIB
+    };
+
+    SaverBinary(const string& name, const string& filePath, Level level = Error,
+                bool isContinue = true);
+
+    // Сжатие записей блока (deflate с уровнем 1). Если сжатый блок оказыва-
+    // ется не меньше исходного, то он записывается без сжатия. Доступно при
+    // сборке с макросом LOGGER_USE_ZLIB. По умолчанию FALSE
+    bool compress() const {return _compress;}
+    void setCompress(bool);
+
+    // Читает блок, расположенный в начале буфера data. Для каждой записи блока
+    // вызывается функция func, сообщение передается с заполненными префиксами,
+    // поэтому текст строки лог-файла можно получить функцией renderLine().
+    // Размер блока: BlockHeader::Size + header.size (если заголовок корректен)
+    static ReadResult readBlock(const char* data, size_t size, BlockHeader& header,
+                                const function<void(const Message&)>& func);
+
+protected:
+    void render(const MessageList&, const Filter::List&,
+                vector<Chunk>& chunks, uint64_t& size) override;
+
+    // Возвращает номер строки str в таблице строк блока
+    uint32_t stringIndex(const char* str);
+
+private:
+    string _buff;       // Заголовок и таблица строк блока
+    string _records;    // Записи сообщений
+    string _compressed; // Сжатые записи сообщений
+    bool   _compress = {false};
+
+    // Таблица строк блока. Поиск выполняется по адресу строки
+    vector<const char*> _strings;
+    unordered_map<const char*, uint32_t> _stringIndexes;
+};
+
+#if !defined(_MSC_VER) && !defined(__MINGW32__) && !defined(__MINGW64__)
+/**
+  Вывод в файл, отображенный в память. Строки лог-файла копируются в отобра-
+  женную область файла, после чего позиция записи (курсор) фиксируется в заго-
+  ловке файла. При аварийном завершении процесса измененные страницы памяти
+  записываются на диск операционной системой, поэтому сохраняются все сообще-
+  ния, переданные сейверу. Место под данные резервируется блоками mapChunkSize
+  байт. Данные лог-файла, следующие за курсором, считаются недействительными.
+  Для извлечения текста лога используется утилита logger/tools/mmap_reader
+*/
+class SaverMmap : public Saver
+{
+public:
+    typedef clife_ptr<SaverMmap> Ptr;
+
+    // Заголовок файла, данные лог-файла следуют за заголовком
+    struct Header
+    {
+        static const uint32_t Size = 4096; // Размер заголовка в файле
+        static const uint32_t Version = 1;
+
+        char     magic[8];   // "ALOGMMAP"
+        uint32_t version;
+        uint32_t headerSize; // Смещение начала данных
+        uint64_t cursor;     // Размер действительных данных
+    };
+
+    SaverMmap(const string& name, const string& filePath, Level level = Error,
+              bool isContinue = true);
+    ~SaverMmap();
+
+    // Возвращает полный путь до лог-файла
+    string filePath() const {return _filePath;}
+
+    // См. описание SaverFile::isContinue()
+    bool isContinue() const {return _isContinue;}
+
+    // Размер блока (в байтах), на который увеличивается отображенная область
+    // файла. По умолчанию 16 MB
+    size_t mapChunkSize() const {return _mapChunkSize;}
+    void setMapChunkSize(size_t);
+
+    // Проверяет заголовок и возвращает действительные данные лог-файла.
+    // При ошибке возвращает FALSE и описание ошибки в параметре error
+    static bool readFile(const string& filePath, string& data, string& error);
+
+    // Сообщения записываются без задержки на накопление
+    bool flushImmediately() const override {return true;}
+
 protected:
     void flushImpl(const MessageList&) override;
 
+    bool openFile();
+    void closeFile();
+
+    // Увеличивает отображенную область так, чтобы после курсора помещалось
+    // size байт
+    bool reserve(uint64_t size);
+
 private:
     string _filePath;
     bool   _isContinue = {true};
+    size_t _mapChunkSize = {16 * 1024 * 1024};
+
+    int     _fd = {-1};
+    char*   _map = {nullptr};
+    size_t  _mapSize = {0};
+    Header* _header = {nullptr};
 };
+#endif
+
+namespace detail {
+
+// Типы аргументов, сохраняемых в бинарном виде в режиме отложенного форматиро-
+// вания. Каждый аргумент записывается в буфер сообщения как: тип (1 байт),
+// значение (для строк: длина uint32_t и символы строки)
+enum class ArgType : char
+{
+    Int64       = 1,
+    UInt64      = 2,
+    Double      = 3,
+    LongDouble  = 4,
+    Bool        = 5,
+    Char        = 6,
+    String      = 7,
+    Timespec    = 8,
+    FormatBegin = 9,  // Начало log_format(), значение - строка формата
+    FormatArg   = 10, // Разделитель аргументов log_format()
+    FormatEnd   = 11  // Окончание log_format()
+};
+
+// Структурированное поле сообщения. Поля записываются в Message::fields как:
+// тип значения (1 байт, ArgType), длина ключа (1 байт), символы ключа, значе-
+// ние. Для значений используются типы Int64, UInt64, Double, Bool и String
+struct Field
+{
+    const char* key;
+    size_t      keySize;
+    ArgType     type;
+    union
+    {
+        int64_t  i64;
+        uint64_t u64;
+        double   dbl;
+        bool     bln;
+    };
+    const char* str;     // Значение для типа String
+    size_t      strSize;
+};
+
+// Извлекает очередное поле из буфера полей сообщения, it - текущая позиция
+// в буфере. Возвращает FALSE, когда поля закончились
+bool nextField(const char*& it, const char* end, Field&);
+
+// Пара ключ/значение, формируется функцией alog::kv(). Строковые значения
+// хранятся по указателю, поэтому объект KeyValue должен использоваться в том
+// же выражении, в котором он создан
+template<typename T>
+struct KeyValue
+{
+    const char* key;
+    T value;
+};
+
+} // namespace detail
 
 /**
   Базовая структура, используется для формирования строки вида:
   logger().debug << "test" << 123;
+
+  Все состояние строки хранится в самом объекте Line (как правило на стеке
+  вызывающего потока). Текст сообщения накапливается во встроенном буфере,
+  динамическая память используется только для сообщений, длина которых
+  превышает размер встроенного буфера
 */
 struct Line
 {
@@ -565,11 +1436,18 @@ struct Line
          int         line,
          const char* module);
 
+    // Конструктор для точки логирования с дескриптором (см. CallSite).
+    // Параметр module передается отдельно, так как для  модульных макросов
+    // наименование модуля может вычисляться при каждом вызове
+    Line(Logger* logger, const CallSite* site, const char* module);
+
     // В деструкторе происходит окончательное формирование сообщения,
     // после чего оно будет добавлено в список сообщений логгера
     ~Line();
 
-    Line(Line&&) = default;
+    // После перемещения исходный объект становится неактивным и сообщение
+    // в логгер не добавляет
+    Line(Line&&);
 
     Line() = delete;
     Line(const Line&) = delete;
@@ -580,20 +1458,77 @@ struct Line
     // нужно ли добавлять сообщение в логгер
     bool toLogger() const;
 
+    // Возвращает TRUE если для строки используется режим отложенного формати-
+    // рования (см. Logger::deferredFormat)
+    bool deferred() const {return impl.deferred;}
+
+    // Записывает аргумент в бинарном виде, используется в режиме отложенного
+    // форматирования. Для строковых аргументов (ArgType::String, FormatBegin)
+    // параметр size определяет длину строки
+    void deferredArg(detail::ArgType, const void* value, size_t size);
+
+    // Записывает структурированное поле сообщения (см. alog::kv()). Для стро-
+    // ковых значений параметр size определяет длину строки. Ключи длиннее 255
+    // символов обрезаются
+    void field(const char* key, detail::ArgType, const void* value, size_t size);
+
+    /**
+      Буфер для накопления текста сообщения. Текст хранится во встроенном
+      массиве inplace, при его переполнении содержимое переносится в строку
+      heap и дальнейшее накопление выполняется в ней
+    */
+    class Buffer
+    {
+    public:
+        Buffer() = default;
+        Buffer(Buffer&&);
+
+        Buffer(const Buffer&) = delete;
+        Buffer& operator= (Buffer&&) = delete;
+        Buffer& operator= (const Buffer&) = delete;
+
+        void append(const char* str, size_t size);
+        void append(char c);
+
+        Buffer& operator+= (const char* s) {append(s, strlen(s)); return *this;}
+        Buffer& operator+= (const string& s) {append(s.data(), s.size()); return *this;}
+        Buffer& operator+= (char c) {append(c); return *this;}
+
+        const char* data() const {return (_heapUsed) ? _heap.data() : _inplace;}
+        size_t size() const {return (_heapUsed) ? _heap.size() : _size;}
+
+        // Передает накопленный текст в строку str. Текст из встроенного массива
+        // копируется (емкость строки str при этом сохраняется), текст из heap
+        // перемещается без копирования
+        void moveTo(string& str);
+
+    private:
+        // Размер встроенного буфера выбран так, чтобы подавляющее большинство
+        // сообщений не требовали выделения динамической памяти
+        char   _inplace[256];
+        size_t _size = {0};
+        bool   _heapUsed = {false};
+        string _heap;
+    };
+
     struct Impl
     {
-        Logger*        logger;
+        Logger*        logger;    // Если logger == nullptr, то объект Line
+                                  // неактивен (например после перемещения)
         Level          level;
         const char*    file;      // Наименование файла
         const char*    func;      // Наименование функции
         int            line;      // Номер строки вызова
         const char*    module;    // Наименование модуля
-        string         buff;
+        const CallSite* site;     // Дескриптор точки логирования
+        bool           deferred;  // Режим отложенного форматирования
+        Buffer         buff;
+        Buffer         fields;    // Структурированные поля (см. field())
         Something::Ptr something; // Параметр используется  для передачи
                                   // произвольных данных от точки логиро-
                                   // вания до сейвера
     };
-    simple_ptr<Impl> impl;
+    Impl impl;
 };
 
 /**
@@ -619,7 +1554,7 @@ public:
     void flush(int loop = 1);
 
     // Заставляет вызывающий поток ждать, пока все сообщения буфера будут
-    // записаны в лог-файлы
+    // записаны в лог-файлы, в том числе асинхронными сейверами
     void waitingFlush();
 
     // Добавляет сейвер для вывода лог-сообщений в stdout. Если сейвер уже был
@@ -655,6 +1590,140 @@ public:
     int  flushSize() const {return _flushSize;}
     void setFlushSize(int val) {_flushSize = val;}
 
+    // Определяет количество сообщений в пакете, приходящееся на один  допол-
+    // нительный поток форматирования префиксов. Если пакет  содержит  больше
+    // сообщений, чем formatThreshold, то форматирование выполняется  парал-
+    // лельно. Значение по умолчанию 50000
+    int  formatThreshold() const {return _formatThreshold;}
+    void setFormatThreshold(int val) {_formatThreshold = val;}
+
+    // Определяет максимальное количество дополнительных потоков форматирова-
+    // ния. Фактическое количество потоков  также  ограничено  числом  ядер
+    // процессора. Значение 0 отключает параллельное форматирование. Значение
+    // по умолчанию 3
+    int  formatThreads() const {return _formatThreads;}
+    void setFormatThreads(int val) {_formatThreads = val;}
+
+    // Политика обработки переполнения очереди сообщений логгера
+    enum class OverflowPolicy
+    {
+        Block      = 0, // Поток-производитель ожидает освобождения места
+                        // в очереди
+        DropNew    = 1, // Новые сообщения с уровнем ниже overflowLevel()
+                        // отбрасываются
+        DropOldest = 2  // В первую очередь отбрасываются самые старые
+                        // сообщения уровней Debug и Debug2
+    };
+
+    // Максимальный размер очереди сообщений логгера: количество сообщений и
+    // суммарный размер текста сообщений в байтах.  В очередь входят  сообще-
+    // ния, ожидающие записи в сейверы. Значение 0 снимает ограничение.  По
+    // умолчанию размер очереди не ограничен
+    int  queueMaxCount() const {return _queueMaxCount;}
+    void setQueueMaxCount(int val) {_queueMaxCount = val;}
+
+    int64_t queueMaxBytes() const {return _queueMaxBytes;}
+    void    setQueueMaxBytes(int64_t val) {_queueMaxBytes = val;}
+
+    // Политика обработки переполнения очереди. Значение по умолчанию Block.
+    // Примечания: 1) Потоки логгера (в том числе потоки асинхронных сейверов)
+    //                никогда не блокируются;
+    //             2) Для политик DropNew и DropOldest при  двукратном  превыше-
+    //                нии размера очереди отбрасываются новые сообщения  любого
+    //                уровня;
+    //             3) Политика DropOldest отбрасывает только сообщения, еще  не
+    //                переданные ни одному сейверу, поэтому все сейверы получают
+    //                одинаковый набор сообщений
+    OverflowPolicy overflowPolicy() const {return _overflowPolicy;}
+    void setOverflowPolicy(OverflowPolicy val) {_overflowPolicy = val;}
+
+    // Уровень сообщений для политики DropNew: при переполнении очереди сооб-
+    // щения с уровнем ниже указанного отбрасываются. Значение по умолчанию Info
+    Level overflowLevel() const {return _overflowLevel;}
+    void  setOverflowLevel(Level val) {_overflowLevel = val;}
+
+    // Интервал (в миллисекундах) вывода в лог сводной информации об отброшен-
+    // ных сообщениях. Значение 0 отключает вывод. По умолчанию 10000 ms
+    int  overflowReportTime() const {return _overflowReportTime;}
+    void setOverflowReportTime(int val) {_overflowReportTime = val;}
+
+    // Количество сообщений уровня level,  отброшенных  из-за  переполнения
+    // очереди
+    uint64_t droppedMessages(Level level) const;
+
+    /**
+      Метрики логгера.
+      Примечание: счетчик dispatched учитывает сообщения, переданные потоком
+      логгера в сейверы. Для синхронных сейверов сообщения учитываются после
+      завершения их записи, для асинхронных - в момент передачи пакета потоку
+      сейвера (запись может быть еще не выполнена). Фильтрация сообщений
+      сейверами и ошибки записи на значение счетчика не влияют, фактически
+      записанные данные отражают метрики сейверов (см. Saver::metrics())
+    */
+    struct Metrics
+    {
+        uint64_t enqueued  [Level::Debug2 + 1] = {0}; // Добавлено в очередь
+        uint64_t dispatched[Level::Debug2 + 1] = {0}; // Передано в сейверы,
+                                                      // см. примечание
+        uint64_t dropped   [Level::Debug2 + 1] = {0}; // Отброшено при перепол-
+                                                      // нении очереди
+        int      queueDepth    = {0}; // Текущий размер очереди
+        int      queueDepthMax = {0}; // Максимальный размер очереди
+        uint64_t batchCount    = {0}; // Количество пакетов сообщений, получен-
+                                      // ных потоком логгера
+        uint64_t batchMessages = {0}; // Количество сообщений во всех пакетах
+        int      batchMax      = {0}; // Максимальный размер пакета
+        uint64_t formatTime    = {0}; // Суммарное время форматирования пре-
+                                      // фиксов сообщений (мкс)
+        uint64_t formatTimeMax = {0}; // Максимальное время форматирования
+                                      // одного пакета (мкс)
+    };
+    typedef std::function<void (const Metrics&)> MetricsCallback;
+
+    // Возвращает снимок метрик логгера. Метрики сейверов доступны через
+    // функцию Saver::metrics()
+    Metrics metrics() const;
+
+    // Устанавливает функцию, которая будет периодически (с интервалом interval
+    // миллисекунд) вызываться в потоке логгера со снимком метрик. Используется
+    // для передачи метрик в системы мониторинга. Для отключения вызова нужно
+    // передать пустую функцию
+    void setMetricsCallback(MetricsCallback, int interval = 10000);
+
+    // Режим отложенного форматирования. В этом режиме точка логирования сохра-
+    // няет в сообщении аргументы операторов '<<' и log_format() в бинарном виде
+    // (числа, строки, строку формата),  а их преобразование  в текст выполня-
+    // ется в потоке логгера. Это позволяет снизить  нагрузку  на  потоки  для
+    // которых критично время выполнения.  По умолчанию режим выключен
+    bool deferredFormat() const {return _deferredFormat;}
+    void setDeferredFormat(bool val) {_deferredFormat = val;}
+
+    // Источник времени для лог-сообщений
+    enum class TimeSource
+    {
+        Precise = 0, // Системные часы реального времени (TIME_UTC)
+        Coarse  = 1, // Часы CLOCK_REALTIME_COARSE: точность определяется
+                     // частотой системного таймера (единицы миллисекунд),
+                     // поэтому микросекунды для режима DEBUG2 не достоверны
+        Tsc     = 2  // Счетчик тактов процессора (TSC). Преобразование
+                     // в системное время выполняется в потоке логгера
+                     // относительно опорной точки, взятой при обработке
+                     // пакета сообщений. Погрешность времени пропорцио-
+                     // нальна времени нахождения сообщения в очереди  и
+                     // погрешности калибровки (не более 10^-5), т.е. при
+                     // задержке в очереди 100 ms не превышает одной мик-
+                     // росекунды. Порядок сообщений при этом сохраняется
+    };
+
+    // Определяет источник времени для лог-сообщений. Значение по умолчанию
+    // Precise. Если выбранный источник недоступен (CLOCK_REALTIME_COARSE не
+    // поддерживается системой, или процессор не имеет инвариантного TSC), то
+    // используется источник Precise.
+    // Примечание: при установке источника Tsc выполняется калибровка счетчика,
+    // которая занимает около 20 ms
+    TimeSource timeSource() const {return _timeSource;}
+    void setTimeSource(TimeSource);
+
     // Добавляет сейвер в список сейверов. Если сейвер с указанным именем уже
     // существует, то он будет заменен новым
     void addSaver(Saver::Ptr);
@@ -678,6 +1747,11 @@ public:
     // ванных на данный момент в логгере
     Level level() const {return _level;}
 
+    // Возвращает TRUE если сообщения с уровнем level будут записаны хотя бы
+    // одним сейвером. Используется для проверки уровня логирования до созда-
+    // ния объекта Line (см. макросы log_error_if, log_debug_if и т.д.)
+    bool levelEnabled(Level level) const {return (level <= _level);}
+
     void redefineLevel();
 
 private:
@@ -690,9 +1764,109 @@ private:
     void addMessage(MessagePtr&&);
     void run() override;
 
+    // Забирает все сообщения из очереди _messagesHead. Сообщения добавляются
+    // в список messages в порядке их поступления в очередь
+    void takeMessages(MessageList& messages);
+
+    // Ожидает поступления новых сообщений. Перед блокировкой  поток  логгера
+    // некоторое время проверяет очередь в активном режиме (spin), после чего
+    // засыпает на условной переменной. Параметр timeout определяет максималь-
+    // ное время ожидания в миллисекундах, при timeout < 0 время ожидания не
+    // ограничено
+    void waitMessages(int timeout);
+
+    // Пробуждает поток логгера
+    void wakeup();
+
+    // Текущее количество сообщений в очереди, вычисляется по сегментирован-
+    // ным счетчикам, поэтому не требует учета в потоках-производителях
+    int queueDepth() const;
+
+    // Возвращает TRUE если размер очереди  превышает  максимальный  в factor
+    // раз с учетом добавляемого сообщения размером bytes
+    bool queueOverflow(int factor, int64_t bytes) const;
+
+    // Проверяет возможность добавления сообщения в очередь в соответствии с
+    // политикой overflowPolicy(). Возвращает FALSE если сообщение  должно
+    // быть отброшено
+    bool queueReserve(const Message&);
+
+    // Исключает сообщения из счетчиков очереди и учитывает их в метриках как
+    // переданные в сейверы
+    void queueRelease(const MessageList&);
+
+    // Отбрасывает самые старые сообщения уровней Debug и Debug2 (политика
+    // DropOldest) из пакета messages, полученного из очереди. Сообщения пакета
+    // еще не переданы ни одному сейверу
+    void queueDropOldest(MessageList& messages);
+
+    // Устанавливает время создания сообщения в соответствии с timeSource()
+    void messageTime(Message&) const;
+
+    // Преобразует значения TSC сообщений в системное время
+    void tscToTimeSpec(MessageList&) const;
+
+    // Формирует сводную информацию об отброшенных сообщениях
+    void overflowReport(uint64_t (&reported)[Level::Debug2 + 1]);
+
+    void stopImpl(bool wait) override;
+
+    // Поток записи сообщений для асинхронного сейвера (см. Saver::async)
+    class SaverWorker;
+
 private:
-    MessageList _messages;
-    mutable atomic_flag  _messagesLock = ATOMIC_FLAG_INIT;
+    // Lock-free очередь  сообщений  (multi-producer/single-consumer).  Очередь
+    // построена как интрузивный односвязный стек (связь через Message::next):
+    // потоки-производители добавляют сообщения в вершину стека при  помощи CAS,
+    // поток логгера забирает весь стек целиком одной  атомарной  операцией и
+    // восстанавливает исходный порядок сообщений
+    atomic<Message*> _messagesHead = {nullptr};
+
+    // Механизм пробуждения потока логгера. Поток-производитель сигнализирует
+    // только при переходе очереди из пустого  состояния в непустое, и только
+    // если поток логгера находится в состоянии ожидания
+    mutex _wakeupLock;
+    condition_variable _wakeupCond;
+    atomic_bool _threadSleeps = {false};
+    atomic_bool _wakeupStop = {false};
+
+    // Счетчики очереди сообщений (см. queueMaxCount, queueMaxBytes)
+    atomic<int>     _queueCount = {0};
+    atomic<int64_t> _queueBytes = {0};
+    atomic<int>     _queueWaiters = {0};
+    atomic<uint64_t> _droppedMessages[Level::Debug2 + 1] = {};
+
+    // Используется для ожидания потоками-производителями освобождения места
+    // в очереди (политика OverflowPolicy::Block)
+    mutex _queueLock;
+    condition_variable _queueCond;
+
+    // Счетчики сообщений, добавленных в очередь. Для снижения конкуренции
+    // между потоками-производителями счетчики разделены на сегменты, каждый
+    // поток использует свой сегмент
+    struct alignas(64) EnqueuedShard
+    {
+        atomic<uint64_t> counts[Level::Debug2 + 1] = {};
+    };
+    static const int EnqueuedShards = 16;
+    EnqueuedShard _enqueued[EnqueuedShards];
+
+    // Количество сообщений, извлеченных из очереди (переданных сейверам
+    // или отброшенных). Изменяется только потоком логгера
+    atomic<uint64_t> _dequeued = {0};
+
+    // Метрики потока логгера (см. Metrics)
+    atomic<uint64_t> _dispatched[Level::Debug2 + 1] = {};
+    atomic<int>      _queueDepthMax = {0};
+    atomic<uint64_t> _batchCount = {0};
+    atomic<uint64_t> _batchMessages = {0};
+    atomic<int>      _batchMax = {0};
+    atomic<uint64_t> _formatTime = {0};
+    atomic<uint64_t> _formatTimeMax = {0};
+
+    MetricsCallback _metricsCallback;
+    int _metricsInterval = {10000};
+    mutable atomic_flag _metricsLock = ATOMIC_FLAG_INIT;
 
     Saver::Ptr  _saverOut;  // Сэйвер для STDOUT
     Saver::Ptr  _saverErr;  // Сэйвер для STDERR
@@ -703,8 +1877,24 @@ private:
 
     int _flushTime = {300};
     int _flushSize = {1000};
+    int _formatThreshold = {50000};
+    int _formatThreads = {3};
+    int _queueMaxCount = {0};
+    int64_t _queueMaxBytes = {0};
+    volatile OverflowPolicy _overflowPolicy = {OverflowPolicy::Block};
+    volatile Level _overflowLevel = {Info};
+    int _overflowReportTime = {10000};
     volatile int _flushLoop = {0};
+
+    // Количество пакетов, переданных асинхронным сейверам и еще не записанных
+    atomic<uint64_t> _asyncPending = {0};
     volatile bool _on = {true};
+    volatile bool _deferredFormat = {false};
+    volatile TimeSource _timeSource = {TimeSource::Precise};
+
+    // Длительность такта TSC в наносекундах (см. TimeSource::Tsc). Записы-
+    // вается функцией setTimeSource(), читается потоком логгера
+    atomic<double> _tscNsecPerTick = {0};
 
     friend struct Line;
     template<typename T, int> friend T& safe::singleton();
@@ -748,7 +1938,7 @@ inline Line Logger::debug2(const char* file, const char* func, int line, const c
 
 inline bool Line::toLogger() const
 {
-    return (impl) ? (impl->level <= impl->logger->level()) : false;
+    return (impl.logger) ? (impl.level <= impl.logger->level()) : false;
 }
 
 Line& operator<< (Line&, bool);
@@ -782,18 +1972,29 @@ Line& stream_operator(Line& line, const T t, typename is_integral<T>::type = 0)
 {
     if (line.toLogger())
     {
+        if (line.deferred())
+        {
+            if (std::is_signed<T>::value)
+            {
+                int64_t val = int64_t(t);
+                line.deferredArg(ArgType::Int64, &val, sizeof(val));
+            }
+            else
+            {
+                uint64_t val = uint64_t(t);
+                line.deferredArg(ArgType::UInt64, &val, sizeof(val));
+            }
+            return line;
+        }
 #if __cplusplus >= 201703L && !defined(LOGGER_USE_SNPRINTF)
         char buff[32];
         to_chars_result res = to_chars(buff, buff + sizeof(buff), t);
         if (res.ec == std::errc())
-        {
-            *res.ptr = '\0';
-            line.impl->buff += buff;
-        }
+            line.impl.buff.append(buff, size_t(res.ptr - buff));
         else
-            line.impl->buff += "INVALID";
+            line.impl.buff += "INVALID";
 #else
-        line.impl->buff += std::to_string(t);
+        line.impl.buff += std::to_string(t);
 #endif
     }
     return line;
@@ -803,7 +2004,23 @@ template<typename T>
 Line& stream_operator(Line& line, const T t, typename is_floating<T>::type = 0)
 {
     if (line.toLogger())
-        line.impl->buff += std::to_string(t);
+    {
+        if (line.deferred())
+        {
+            if (sizeof(T) > sizeof(double))
+            {
+                long double val = t;
+                line.deferredArg(ArgType::LongDouble, &val, sizeof(val));
+            }
+            else
+            {
+                double val = t;
+                line.deferredArg(ArgType::Double, &val, sizeof(val));
+            }
+            return line;
+        }
+        line.impl.buff += std::to_string(t);
+    }
     return line;
 }
 
@@ -826,6 +2043,57 @@ Line& stream_operator(Line& line, const T, typename not_supported<T>::type = 0)
     return line;
 }
 
+template<typename T>
+void field_value(Line& line, const char* key, const T t, typename is_integral<T>::type = 0)
+{
+    if (std::is_same<T, bool>::value)
+    {
+        bool val = bool(t);
+        line.field(key, ArgType::Bool, &val, sizeof(val));
+    }
+    else if (std::is_same<T, char>::value)
+    {
+        char val = char(t);
+        line.field(key, ArgType::String, &val, 1);
+    }
+    else if (std::is_signed<T>::value)
+    {
+        int64_t val = int64_t(t);
+        line.field(key, ArgType::Int64, &val, sizeof(val));
+    }
+    else
+    {
+        uint64_t val = uint64_t(t);
+        line.field(key, ArgType::UInt64, &val, sizeof(val));
+    }
+}
+
+template<typename T>
+void field_value(Line& line, const char* key, const T t, typename is_floating<T>::type = 0)
+{
+    double val = double(t);
+    line.field(key, ArgType::Double, &val, sizeof(val));
+}
+
+template<typename T>
+void field_value(Line& line, const char* key, const T t, typename is_enum_type<T>::type = 0)
+{
+    typedef typename std::underlying_type<T>::type integral_type;
+    field_value(line, key, static_cast<integral_type>(t));
+}
+
+inline void field_value(Line& line, const char* key, const char* t)
+{
+    if (t == nullptr)
+        t = "";
+    line.field(key, ArgType::String, t, strlen(t));
+}
+
+inline void field_value(Line& line, const char* key, const string* t)
+{
+    line.field(key, ArgType::String, t->data(), t->size());
+}
+
 inline constexpr char file_sep()
 {
 #if defined(_MSC_VER)
@@ -853,6 +2121,13 @@ inline constexpr const char* file_name(const char (&s)[length])
     return file_name<length - 2>(s + length - 2, 0);
 }
 
+// Вспомогательная структура, используется в макросах условного логирования
+// для приведения выражения вида Line << ... << ... к типу void
+struct LineVoid
+{
+    void operator& (const Line&) const {}
+};
+
 } // namespace detail
 
 template<typename T>
@@ -862,7 +2137,44 @@ Line& operator<< (Line& line, const T& t)
 }
 
 template<typename T>
-Line operator<< (Line&& line, const T& t)
+Line& operator<< (Line& line, const detail::KeyValue<T>& kv)
+{
+    if (line.toLogger())
+        detail::field_value(line, kv.key, kv.value);
+    return line;
+}
+
+// Формирует структурированное поле сообщения. Пример:
+//   log_info << "Request completed" << alog::kv("user", userId)
+//                                   << alog::kv("elapsed_ms", 12.5);
+// В текстовых лог-файлах поля выводятся после текста сообщения в виде пар
+// key=value, сейвер SaverJson записывает поля как элементы JSON-объекта
+// (ключи, совпадающие с основными полями объекта, получают префикс '_').
+// Ключ - статическая строка (литерал), значение - число, bool, enum или
+// строка. Поля сохраняются во встроенном буфере объекта Line, динамическая
+// память в точке логирования не используется
+template<typename T, typename std::enable_if<std::is_arithmetic<T>::value
+                                          || std::is_enum<T>::value, int>::type = 0>
+inline detail::KeyValue<T> kv(const char* key, T value)
+{
+    return {key, value};
+}
+
+inline detail::KeyValue<const char*> kv(const char* key, const char* value)
+{
+    return {key, value};
+}
+
+inline detail::KeyValue<const string*> kv(const char* key, const string& value)
+{
+    return {key, &value};
+}
+
+// Оператор для временного объекта Line возвращает ссылку на этот же  объект,
+// это исключает перемещение (копирование встроенного буфера) на каждом шаге
+// цепочки вызовов вида: logger().debug(...) << "a" << 1
+template<typename T>
+Line&& operator<< (Line&& line, const T& t)
 {
     operator<< (line, t);
     return std::move(line);
@@ -902,9 +2214,75 @@ string round(double value, int signCount = 2);
 #define alog_line_location   alog::detail::file_name(__FILE__), __func__, __LINE__
 #define alog_line_(LOG_LINE) alog::detail::file_name(__FILE__), __func__, LOG_LINE
 
-#define log_error   alog::logger().error   (alog_line_location)
-#define log_warn    alog::logger().warn    (alog_line_location)
-#define log_info    alog::logger().info    (alog_line_location)
-#define log_verbose alog::logger().verbose (alog_line_location)
-#define log_debug   alog::logger().debug   (alog_line_location)
-#define log_debug2  alog::logger().debug2  (alog_line_location)
+// Максимальный уровень логирования, определяемый на этапе компиляции. Точки
+// условного логирования (log_debug_if и т.д.) с уровнем выше ALOG_MIN_LEVEL
+// (т.е. менее значимые) полностью удаляются из кода программы. Например, при
+// сборке с ключом -DALOG_MIN_LEVEL=5 будут удалены все вызовы уровня Debug2.
+// По умолчанию сохраняются вызовы всех уровней
+#ifndef ALOG_MIN_LEVEL
+#define ALOG_MIN_LEVEL 6 /*alog::Debug2*/
+#endif
+
+// Возвращает TRUE если сообщения уровня LEVEL будут записаны в лог
+#define alog_level_enabled(LEVEL) \
+    ((alog::LEVEL <= ALOG_MIN_LEVEL) && alog::logger().levelEnabled(alog::LEVEL))
+
+// Создает объект Line со статическим дескриптором точки логирования (см.
+// CallSite). Дескриптор инициализируется при первом выполнении точки логи-
+// рования. Выражение MODULE вычисляется при каждом выполнении, дескриптор
+// сохраняет только первое значение. Если при следующем выполнении значение
+// MODULE отличается (сравниваются указатели), то кэшированные в дескрипто-
+// ре данные модуля не используются: сообщение получает собственный модуль
+#define alog_line_site(LEVEL, MODULE)                                          \
+    [](const char* func_, const char* module_) -> alog::Line {                 \
+        static const alog::CallSite site_ {alog::LEVEL,                        \
+            alog::detail::file_name(__FILE__), func_, __LINE__, module_};      \
+        return alog::Line(&alog::logger(), &site_, module_);                   \
+    }(__func__, MODULE)
+
+// Макросы для определения модульных вариантов логирования. Результат выра-
+// жения имеет тип Line, поэтому допустима запись вида
+//   alog::Line line = log_debug_m << ...;
+// Пример определения:
+//   #define log_error_m   alog_error_m  ("ModuleName")
+//   #define log_debug2_m  alog_debug2_m ("ModuleName")
+#define alog_error_m(MODULE)   alog_line_site(Error,   MODULE)
+#define alog_warn_m(MODULE)    alog_line_site(Warning, MODULE)
+#define alog_info_m(MODULE)    alog_line_site(Info,    MODULE)
+#define alog_verbose_m(MODULE) alog_line_site(Verbose, MODULE)
+#define alog_debug_m(MODULE)   alog_line_site(Debug,   MODULE)
+#define alog_debug2_m(MODULE)  alog_line_site(Debug2,  MODULE)
+
+#define log_error   alog_error_m   (0)
+#define log_warn    alog_warn_m    (0)
+#define log_info    alog_info_m    (0)
+#define log_verbose alog_verbose_m (0)
+#define log_debug   alog_debug_m   (0)
+#define log_debug2  alog_debug2_m  (0)
+
+// Условное логирование: уровень логирования проверяется до создания  объекта
+// Line, поэтому при отключенном уровне аргументы операторов '<<' не вычисля-
+// ются, а точки логирования с уровнем выше ALOG_MIN_LEVEL удаляются из кода.
+// Результат выражения имеет тип void, поэтому запись вида
+//   alog::Line line = log_debug_if << ...;
+// недопустима, для таких случаев следует использовать макросы log_debug,
+// alog_debug_m и т.д.
+#define alog_line_if(LEVEL, MODULE)                                            \
+    !alog_level_enabled(LEVEL) ? (void)0                                       \
+        : alog::detail::LineVoid() & alog_line_site(LEVEL, MODULE)
+
+// Модульные варианты условного логирования. Пример:
+//   #define log_debug_if_m  alog_debug_if_m ("ModuleName")
+#define alog_error_if_m(MODULE)   alog_line_if(Error,   MODULE)
+#define alog_warn_if_m(MODULE)    alog_line_if(Warning, MODULE)
+#define alog_info_if_m(MODULE)    alog_line_if(Info,    MODULE)
+#define alog_verbose_if_m(MODULE) alog_line_if(Verbose, MODULE)
+#define alog_debug_if_m(MODULE)   alog_line_if(Debug,   MODULE)
+#define alog_debug2_if_m(MODULE)  alog_line_if(Debug2,  MODULE)
+
+#define log_error_if   alog_error_if_m   (0)
+#define log_warn_if    alog_warn_if_m    (0)
+#define log_info_if    alog_info_if_m    (0)
+#define log_verbose_if alog_verbose_if_m (0)
+#define log_debug_if   alog_debug_if_m   (0)
+#define log_debug2_if  alog_debug2_if_m  (0)
@@ -0,0 +1,753 @@
+/* clang-format off */
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2026 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "logger/matchers.h"
+
+#include <cctype>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+
+namespace alog {
+namespace detail {
+
+//------------------------------- MultiMatcher -------------------------------
+
+void MultiMatcher::compile(const vector<string>& patterns)
+{
+    _empty = patterns.empty();
+    _classCount = 1;
+    memset(_classes, 0, sizeof(_classes));
+    _delta.clear();
+    _accept.clear();
+
+    // Байты, встречающиеся в подстроках, получают собственные классы. Все
+    // остальные байты относятся к классу 0 и всегда ведут к переходу по
+    // суффиксной ссылке. Подстроки из 255 различных байт и более сводят
+    // сжатие на нет, в этом случае каждый байт получает свой класс
+    for (const string& pattern : patterns)
+        for (unsigned char c : pattern)
+            if (_classes[c] == 0)
+            {
+                if (_classCount == 256)
+                    break;
+                _classes[c] = uint8_t(_classCount++);
+            }
+
+    if (_classCount == 256)
+    {
+        for (int c = 0; c < 256; ++c)
+            _classes[c] = uint8_t(c);
+    }
+
+    // Бор подстрок. Отсутствующий переход обозначается нулем: возврат
+    // в корень по переходу из корня невозможен, поэтому значение однозначно
+    _delta.assign(_classCount, 0);
+    _accept.assign(1, 0);
+
+    for (const string& pattern : patterns)
+    {
+        uint32_t state = 0;
+        for (unsigned char c : pattern)
+        {
+            uint32_t& next = _delta[state * _classCount + _classes[c]];
+            if (next == 0)
+            {
+                next = uint32_t(_accept.size());
+                _accept.push_back(0);
+                _delta.resize(_delta.size() + _classCount, 0);
+            }
+            // Ссылка 'next' могла стать невалидной после resize()
+            state = _delta[state * _classCount + _classes[c]];
+        }
+        _accept[state] = 1;
+    }
+
+    // Построение суффиксных ссылок обходом в ширину. Отсутствующие переходы
+    // заменяются переходами суффиксного состояния, в результате бор превра-
+    // щается в полную таблицу переходов детерминированного автомата
+    vector<uint32_t> fail(_accept.size(), 0);
+    std::deque<uint32_t> queue;
+    for (uint32_t c = 0; c < _classCount; ++c)
+        if (uint32_t next = _delta[c])
+            queue.push_back(next);
+
+    while (!queue.empty())
+    {
+        uint32_t state = queue.front();
+        queue.pop_front();
+
+        // Состояние является конечным, если конечным является его суффикс
+        if (_accept[fail[state]])
+            _accept[state] = 1;
+
+        for (uint32_t c = 0; c < _classCount; ++c)
+        {
+            uint32_t& next = _delta[state * _classCount + c];
+            uint32_t failNext = _delta[fail[state] * _classCount + c];
+            if (next)
+            {
+                fail[next] = failNext;
+                queue.push_back(next);
+            }
+            else
+                next = failNext;
+        }
+    }
+}
+
+bool MultiMatcher::match(const char* text, size_t size) const
+{
+    if (_empty)
+        return false;
+
+    // Пустая подстрока содержится в любом тексте
+    if (_accept[0])
+        return true;
+
+    const uint32_t* delta = _delta.data();
+    const uint8_t* accept = _accept.data();
+    const unsigned char* p = (const unsigned char*)text;
+    const unsigned char* end = p + size;
+
+    uint32_t state = 0;
+    for (; p != end; ++p)
+    {
+        state = delta[state * _classCount + _classes[*p]];
+        if (accept[state])
+            return true;
+    }
+    return false;
+}
+
+//------------------------------ PatternMatcher ------------------------------
+
+namespace {
+
+typedef PatternMatcher::Inst Inst;
+typedef PatternMatcher::CharClass CharClass;
+
+// Ограничение на размер программы. Конструкции вида (a{100}){100} в против-
+// ном случае приводят к неограниченному росту программы
+const size_t patternMaxProgram = 100000;
+const int    patternMaxRepeat = 1000;
+
+// Узел синтаксического дерева шаблона
+struct Node
+{
+    enum Kind {Class, Cat, Alt, Repeat, Empty, Bol, Eol};
+    Kind kind;
+    int  a = {-1};   // Первый (единственный) дочерний узел
+    int  b = {-1};   // Второй дочерний узел
+    int  cls = {-1}; // Индекс класса символов (для Class)
+    int  min = {0};  // Границы повторения (для Repeat), max == -1
+    int  max = {-1}; // соответствует бесконечности
+};
+
+class PatternParser
+{
+public:
+    PatternParser(const string& pattern, vector<Node>& nodes,
+                  vector<CharClass>& classes)
+        : _p(pattern.c_str()), _end(pattern.c_str() + pattern.size()),
+          _nodes(nodes), _classes(classes)
+    {}
+
+    int parseRegex()
+    {
+        int node = alternation();
+        if (_p != _end)
+            error("unexpected ')'");
+        return node;
+    }
+
+    int parseGlob()
+    {
+        int node = newNode(Node::Bol);
+        while (_p != _end)
+        {
+            char c = *_p++;
+            int item;
+            if (c == '*')
+            {
+                CharClass cc;
+                fill(cc);
+                item = newNode(Node::Repeat, newClassNode(cc));
+            }
+            else if (c == '?')
+            {
+                CharClass cc;
+                fill(cc);
+                item = newClassNode(cc);
+            }
+            else if (c == '[')
+                item = bracket('!');
+            else
+            {
+                if (c == '\\')
+                {
+                    if (_p == _end)
+                        error("trailing '\\'");
+                    c = *_p++;
+                }
+                item = literal(c);
+            }
+            node = newNode(Node::Cat, node, item);
+        }
+        return newNode(Node::Cat, node, newNode(Node::Eol));
+    }
+
+private:
+    int alternation()
+    {
+        int node = concatenation();
+        while (_p != _end && *_p == '|')
+        {
+            ++_p;
+            node = newNode(Node::Alt, node, concatenation());
+        }
+        return node;
+    }
+
+    int concatenation()
+    {
+        int node = -1;
+        while (_p != _end && *_p != '|' && *_p != ')')
+        {
+            int item = repetition();
+            node = (node < 0) ? item : newNode(Node::Cat, node, item);
+        }
+        return (node < 0) ? newNode(Node::Empty) : node;
+    }
+
+    int repetition()
+    {
+        int node = atom();
+        while (_p != _end)
+        {
+            int min, max;
+            if (*_p == '*')
+                {min = 0; max = -1; ++_p;}
+            else if (*_p == '+')
+                {min = 1; max = -1; ++_p;}
+            else if (*_p == '?')
+                {min = 0; max = 1; ++_p;}
+            else if (*_p == '{')
+            {
+                ++_p;
+                min = number();
+                max = min;
+                if (_p != _end && *_p == ',')
+                {
+                    ++_p;
+                    max = (_p != _end && *_p == '}') ? -1 : number();
+                }
+                if (_p == _end || *_p != '}')
+                    error("expected '}'");
+                ++_p;
+                if (max != -1 && max < min)
+                    error("invalid repetition range");
+            }
+            else
+                break;
+
+            node = newNode(Node::Repeat, node);
+            _nodes[node].min = min;
+            _nodes[node].max = max;
+        }
+        return node;
+    }
+
+    int atom()
+    {
+        char c = *_p++;
+        switch (c)
+        {
+            case '(':
+            {
+                if ((_end - _p) >= 2 && _p[0] == '?' && _p[1] == ':')
+                    _p += 2;
+                int node = alternation();
+                if (_p == _end || *_p != ')')
+                    error("expected ')'");
+                ++_p;
+                return node;
+            }
+            case '[':
+                return bracket('^');
+
+            case '.':
+            {
+                // Как и в std::regex (ECMAScript), символ '.' не совпадает
+                // с переводом строки
+                CharClass cc;
+                fill(cc);
+                cc.remove('\n');
+                return newClassNode(cc);
+            }
+            case '^':
+                return newNode(Node::Bol);
+
+            case '$':
+                return newNode(Node::Eol);
+
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+                error(string("nothing to repeat before '") + c + "'");
+                break;
+
+            case '\\':
+            {
+                CharClass cc;
+                escape(cc);
+                return newClassNode(cc);
+            }
+        }
+        return literal(c);
+    }
+
+    // Разбор выражения в квадратных скобках, открывающая скобка уже прочитана
+    int bracket(char negation)
+    {
+        CharClass cc;
+        bool negate = false;
+        if (_p != _end && *_p == negation)
+        {
+            negate = true;
+            ++_p;
+        }
+        bool first = true;
+        while (true)
+        {
+            if (_p == _end)
+                error("expected ']'");
+
+            unsigned char c = *_p++;
+            if (c == ']' && !first)
+                break;
+            first = false;
+
+            if (c == '\\')
+            {
+                escape(cc);
+                continue;
+            }
+            if ((_end - _p) >= 2 && _p[0] == '-' && _p[1] != ']')
+            {
+                unsigned char last = _p[1];
+                if (last == '\\')
+                    error("escape can not end a range");
+                if (last < c)
+                    error("invalid character range");
+                _p += 2;
+                for (int i = c; i <= last; ++i)
+                    cc.add(i);
+                continue;
+            }
+            cc.add(c);
+        }
+        if (negate)
+            for (uint64_t& w : cc.bits)
+                w = ~w;
+
+        return newClassNode(cc);
+    }
+
+    // Разбор escape-последовательности, символ '\' уже прочитан
+    void escape(CharClass& cc)
+    {
+        if (_p == _end)
+            error("trailing '\\'");
+
+        char c = *_p++;
+        CharClass tmp;
+        bool negate = false;
+        switch (c)
+        {
+            case 'D': negate = true; [[fallthrough]];
+            case 'd':
+                for (int i = '0'; i <= '9'; ++i)
+                    tmp.add(i);
+                break;
+
+            case 'W': negate = true; [[fallthrough]];
+            case 'w':
+                for (int i = 0; i < 256; ++i)
+                    if (isalnum(i) || i == '_')
+                        tmp.add(i);
+                break;
+
+            case 'S': negate = true; [[fallthrough]];
+            case 's':
+                for (char i : {' ', '\t', '\n', '\r', '\f', '\v'})
+                    tmp.add(i);
+                break;
+
+            case 'n': tmp.add('\n'); break;
+            case 'r': tmp.add('\r'); break;
+            case 't': tmp.add('\t'); break;
+
+            default:
+                tmp.add(c);
+        }
+        for (int i = 0; i < 4; ++i)
+            cc.bits[i] |= (negate) ? ~tmp.bits[i] : tmp.bits[i];
+    }
+
+    int number()
+    {
+        if (_p == _end || !isdigit((unsigned char)*_p))
+            error("expected number in repetition");
+
+        int n = 0;
+        while (_p != _end && isdigit((unsigned char)*_p))
+        {
+            n = n * 10 + (*_p++ - '0');
+            if (n > patternMaxRepeat)
+                error("repetition count is too large");
+        }
+        return n;
+    }
+
+    int literal(char c)
+    {
+        CharClass cc;
+        cc.add(c);
+        return newClassNode(cc);
+    }
+
+    static void fill(CharClass& cc)
+    {
+        for (uint64_t& w : cc.bits)
+            w = ~uint64_t(0);
+    }
+
+    int newClass(const CharClass& cc)
+    {
+        _classes.push_back(cc);
+        return int(_classes.size() - 1);
+    }
+
+    int newClassNode(const CharClass& cc)
+    {
+        int node = newNode(Node::Class);
+        _nodes[node].cls = newClass(cc);
+        return node;
+    }
+
+    // Для Repeat по умолчанию создается повторение вида '*'
+    int newNode(Node::Kind kind, int a = -1, int b = -1)
+    {
+        Node node;
+        node.kind = kind;
+        node.a = a;
+        node.b = b;
+        _nodes.push_back(node);
+        return int(_nodes.size() - 1);
+    }
+
+    [[noreturn]] void error(const string& msg)
+    {
+        throw std::logic_error(msg);
+    }
+
+private:
+    const char* _p;
+    const char* _end;
+    vector<Node>& _nodes;
+    vector<CharClass>& _classes;
+};
+
+class PatternEmitter
+{
+public:
+    PatternEmitter(const vector<Node>& nodes, vector<Inst>& program)
+        : _nodes(nodes), _program(program)
+    {}
+
+    void emit(int index)
+    {
+        if (_program.size() > patternMaxProgram)
+            throw std::logic_error("pattern is too large");
+
+        const Node& node = _nodes[index];
+        switch (node.kind)
+        {
+            case Node::Class:
+                add(Inst::Byte, uint32_t(node.cls));
+                break;
+
+            case Node::Cat:
+                emit(node.a);
+                emit(node.b);
+                break;
+
+            case Node::Alt:
+            {
+                uint32_t split = add(Inst::Split);
+                _program[split].x = pc();
+                emit(node.a);
+                uint32_t jmp = add(Inst::Jmp);
+                _program[split].y = pc();
+                emit(node.b);
+                _program[jmp].x = pc();
+                break;
+            }
+            case Node::Repeat:
+            {
+                for (int i = 0; i < node.min; ++i)
+                    emit(node.a);
+
+                if (node.max == -1)
+                {
+                    // L1: split L2, L3; L2: a; jmp L1; L3:
+                    uint32_t split = add(Inst::Split);
+                    _program[split].x = pc();
+                    emit(node.a);
+                    add(Inst::Jmp, split);
+                    _program[split].y = pc();
+                }
+                else
+                {
+                    // Необязательные повторения: split L1, Lend; L1: a; ...
+                    vector<uint32_t> splits;
+                    for (int i = node.min; i < node.max; ++i)
+                    {
+                        uint32_t split = add(Inst::Split);
+                        _program[split].x = pc();
+                        splits.push_back(split);
+                        emit(node.a);
+                    }
+                    for (uint32_t split : splits)
+                        _program[split].y = pc();
+                }
+                break;
+            }
+            case Node::Empty:
+                break;
+
+            case Node::Bol:
+                add(Inst::Bol);
+                break;
+
+            case Node::Eol:
+                add(Inst::Eol);
+                break;
+        }
+    }
+
+    uint32_t add(Inst::Op op, uint32_t x = 0)
+    {
+        Inst inst;
+        inst.op = op;
+        inst.x = x;
+        _program.push_back(inst);
+        return uint32_t(_program.size() - 1);
+    }
+
+private:
+    uint32_t pc() const {return uint32_t(_program.size());}
+
+    const vector<Node>& _nodes;
+    vector<Inst>& _program;
+};
+
+// Множество активных потоков Pike VM (sparse set): добавление, проверка и
+// очистка выполняются за O(1)
+struct ThreadList
+{
+    vector<uint32_t> dense;
+    vector<uint32_t> sparse;
+    uint32_t count = {0};
+
+    void reset(size_t size)
+    {
+        if (sparse.size() < size)
+        {
+            sparse.resize(size);
+            dense.resize(size);
+        }
+        count = 0;
+    }
+    bool contains(uint32_t pc) const
+    {
+        uint32_t i = sparse[pc];
+        return (i < count) && (dense[i] == pc);
+    }
+    void insert(uint32_t pc)
+    {
+        sparse[pc] = count;
+        dense[count++] = pc;
+    }
+};
+
+struct PatternScratch
+{
+    ThreadList lists[2];
+    vector<uint32_t> stack;
+};
+
+thread_local PatternScratch patternScratch;
+
+// Добавляет поток и все потоки, достижимые из него без чтения символа
+void addThread(const vector<Inst>& program, ThreadList& list, vector<uint32_t>& stack,
+               uint32_t pc, size_t pos, size_t size)
+{
+    stack.clear();
+    stack.push_back(pc);
+    while (!stack.empty())
+    {
+        pc = stack.back();
+        stack.pop_back();
+        if (list.contains(pc))
+            continue;
+
+        list.insert(pc);
+        const Inst& inst = program[pc];
+        switch (inst.op)
+        {
+            case Inst::Jmp:
+                stack.push_back(inst.x);
+                break;
+
+            case Inst::Split:
+                // Порядок обхода для логического результата не важен
+                stack.push_back(inst.y);
+                stack.push_back(inst.x);
+                break;
+
+            case Inst::Bol:
+                if (pos == 0)
+                    stack.push_back(pc + 1);
+                break;
+
+            case Inst::Eol:
+                if (pos == size)
+                    stack.push_back(pc + 1);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+} // namespace
+
+bool PatternMatcher::compile(const vector<string>& patterns, Syntax syntax,
+                             string* error)
+{
+    _program.clear();
+    _classes.clear();
+    if (patterns.empty())
+        return true;
+
+    try
+    {
+        vector<Node> nodes;
+        int root = -1;
+        for (const string& pattern : patterns)
+        {
+            PatternParser parser {pattern, nodes, _classes};
+            int node = (syntax == Syntax::Glob) ? parser.parseGlob()
+                                                : parser.parseRegex();
+            if (root < 0)
+            {
+                root = node;
+                continue;
+            }
+            Node alt;
+            alt.kind = Node::Alt;
+            alt.a = root;
+            alt.b = node;
+            nodes.push_back(alt);
+            root = int(nodes.size() - 1);
+        }
+        PatternEmitter emitter {nodes, _program};
+        emitter.emit(root);
+        emitter.add(Inst::Match);
+    }
+    catch (std::exception& e)
+    {
+        _program.clear();
+        _classes.clear();
+        if (error)
+            *error = e.what();
+        return false;
+    }
+    return true;
+}
+
+bool PatternMatcher::check(const string& pattern, Syntax syntax, string* error)
+{
+    PatternMatcher matcher;
+    return matcher.compile({pattern}, syntax, error);
+}
+
+bool PatternMatcher::match(const char* text, size_t size) const
+{
+    if (_program.empty())
+        return false;
+
+    PatternScratch& scratch = patternScratch;
+    ThreadList* clist = &scratch.lists[0];
+    ThreadList* nlist = &scratch.lists[1];
+    clist->reset(_program.size());
+    nlist->reset(_program.size());
+
+    const unsigned char* p = (const unsigned char*)text;
+    for (size_t pos = 0; ; ++pos)
+    {
+        // Поиск в любом месте текста: на каждой позиции запускается новый
+        // поток с начала программы
+        addThread(_program, *clist, scratch.stack, 0, pos, size);
+
+        for (uint32_t i = 0; i < clist->count; ++i)
+        {
+            const Inst& inst = _program[clist->dense[i]];
+            if (inst.op == Inst::Match)
+                return true;
+
+            if (inst.op == Inst::Byte && pos < size
+                && _classes[inst.x].contains(p[pos]))
+            {
+                addThread(_program, *nlist, scratch.stack,
+                          clist->dense[i] + 1, pos + 1, size);
+            }
+        }
+        if (pos == size)
+            break;
+
+        std::swap(clist, nlist);
+        nlist->count = 0;
+    }
+    return false;
+}
+
+} // namespace detail
+} // namespace alog
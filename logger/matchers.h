@@ -0,0 +1,145 @@
+/* clang-format off */
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2026 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Механизмы поиска для фильтров логгера.
+
+*****************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace alog {
+namespace detail {
+
+using namespace std;
+
+/**
+  Поиск нескольких подстрок за один проход по тексту (алгоритм Aho-Corasick).
+  Набор подстрок компилируется в детерминированный автомат. Для уменьшения
+  размера таблицы переходов байты, не входящие ни в одну подстроку, объединя-
+  ются в общий класс символов
+*/
+class MultiMatcher
+{
+public:
+    // Компилирует автомат для набора подстрок. Повторный вызов заменяет ранее
+    // скомпилированный автомат
+    void compile(const vector<string>& patterns);
+
+    // Возвращает TRUE если текст содержит хотя бы одну из подстрок
+    bool match(const char* text, size_t size) const;
+    bool match(const string& text) const {return match(text.c_str(), text.size());}
+
+    // Возвращает TRUE если набор подстрок пуст
+    bool empty() const {return _empty;}
+
+private:
+    bool _empty = {true};
+
+    // Число классов символов (ширина строки таблицы переходов)
+    uint32_t _classCount = {1};
+
+    // Отображение байта в класс символов
+    uint8_t _classes[256] = {0};
+
+    // Таблица переходов: _delta[state * _classCount + class]
+    vector<uint32_t> _delta;
+
+    // Признак конечного состояния (найдена одна из подстрок)
+    vector<uint8_t> _accept;
+};
+
+/**
+  Сопоставление с шаблонами (glob или регулярные выражения). Шаблоны компи-
+  лируются в программу недетерминированного автомата (NFA Томпсона), которая
+  исполняется без возвратов (Pike VM). Время сопоставления линейно зависит от
+  длины текста и не зависит от вида шаблона.
+
+  Поддерживаемый синтаксис glob: '*', '?', '[abc]', '[a-z]', '[!a-z]',  '\'
+  для экранирования. Glob-шаблон должен совпадать со всем текстом, символы
+  '*' и '?' совпадают с любым байтом, в том числе с '\n'.
+
+  Поддерживаемый синтаксис регулярных выражений: '.', '[...]', '[^...]', '^',
+  '$', '|', '(...)', '(?:...)', '*', '+', '?', '{m}', '{m,}', '{m,n}', классы
+  \d \D \w \W \s \S, экранирование '\'. Поиск выполняется в любом месте
+  текста (как std::regex_search), для привязки к началу/концу используются
+  '^' и '$'. Символ '.' не совпадает с '\n', '^' и '$' совпадают  только  с
+  началом и концом всего текста (многострочный режим не поддерживается).
+*/
+class PatternMatcher
+{
+public:
+    enum class Syntax
+    {
+        Glob  = 0,
+        Regex = 1
+    };
+
+    // Компилирует программу для набора шаблонов, текст считается совпавшим
+    // если он совпадает хотя бы с одним шаблоном. Если шаблон содержит син-
+    // таксическую ошибку, то функция возвращает FALSE, описание ошибки  по-
+    // мещается в параметр error
+    bool compile(const vector<string>& patterns, Syntax, string* error = nullptr);
+
+    // Проверяет корректность шаблона
+    static bool check(const string& pattern, Syntax, string* error = nullptr);
+
+    bool match(const char* text, size_t size) const;
+    bool match(const string& text) const {return match(text.c_str(), text.size());}
+
+    bool empty() const {return _program.empty();}
+
+public:
+    // Инструкция программы
+    struct Inst
+    {
+        enum Op : uint8_t {Byte, Split, Jmp, Bol, Eol, Match};
+        Op       op;
+        uint32_t x = {0}; // Для Byte - индекс класса символов
+        uint32_t y = {0};
+    };
+
+    // Класс символов: битовая карта на 256 значений
+    struct CharClass
+    {
+        uint64_t bits[4] = {0, 0, 0, 0};
+
+        void add(unsigned char c) {bits[c >> 6] |= (uint64_t(1) << (c & 63));}
+        void remove(unsigned char c) {bits[c >> 6] &= ~(uint64_t(1) << (c & 63));}
+        bool contains(unsigned char c) const {return (bits[c >> 6] >> (c & 63)) & 1;}
+    };
+
+private:
+    vector<Inst> _program;
+    vector<CharClass> _classes;
+};
+
+} // namespace detail
+} // namespace alog
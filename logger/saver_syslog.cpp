@@ -54,15 +54,21 @@ void SaverSyslog::flushImpl(const MessageList& messages)
         }
     };
 
+    // Буфер используется для всех сообщений пакета. Текст сообщений в syslog
+    // не обрезается
+    string str;
     for (Message* m : messages)
     {
         if (m->level > level())
             continue;
 
-        string str {m->prefix3};
-        str += m->str;
+        const RenderedLine& line = renderLine(*m, LineLayout::Syslog, 0, utf8Sanitize());
+        str.clear();
+        for (int i = 0; i < line.count; ++i)
+            str.append(line.parts[i], line.sizes[i]);
 
         syslog(syslogLevel(m->level), "%s", str.c_str());
+        addBytesWritten(str.size());
     }
 }
 
@@ -0,0 +1,133 @@
+/*****************************************************************************
+  Утилита преобразования лог-файла сейвера SaverBinary в текстовый вид. Вы-
+  водит в stdout (или в файл, указанный вторым параметром) строки лога в том
+  же виде, в котором их записывает сейвер SaverFile. Поврежденные блоки про-
+  пускаются, чтение продолжается со следующего блока. Для чтения сжатых бло-
+  ков (см. SaverBinary::compress()) утилита собирается с макросом LOGGER_USE_-
+  ZLIB, иначе сжатые блоки пропускаются
+
+*****************************************************************************/
+
+// Команда для сборки
+// g++ -std=c++17 -O2 -DNDEBUG -DLOGGER_USE_ZLIB -I../.. alog_decode.cpp ../logger.cpp ../matchers.cpp ../utf8.cpp ../../thread/thread_base.cpp ../../thread/thread_utils.cpp -lz -lpthread -o alog_decode
+
+#include "logger/logger.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+using namespace std;
+using namespace alog;
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s BINARY_LOG_FILE [OUTPUT_FILE]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* in = fopen(argv[1], "rb");
+    if (in == 0)
+    {
+        fprintf(stderr, "Could not open file: %s\n", argv[1]);
+        return 1;
+    }
+
+    FILE* out = (argc > 2) ? fopen(argv[2], "w") : stdout;
+    if (out == 0)
+    {
+        fprintf(stderr, "Could not open file: %s\n", argv[2]);
+        fclose(in);
+        return 1;
+    }
+
+    SaverBinary::BlockHeader header;
+    LineLayout layout = LineLayout::Normal;
+    bool res = true;
+    uint64_t corrupted = 0;
+    uint64_t unsupported = 0;
+
+    auto writeLine = [&](const Message& m)
+    {
+        const RenderedLine& line = renderLine(m, layout, 0);
+        for (int i = 0; i < line.count; ++i)
+            res = res && (fwrite(line.parts[i], 1, line.sizes[i], out) == line.sizes[i]);
+        res = res && (fputc('\n', out) != EOF);
+    };
+
+    // Файл читается частями, в буфере сохраняются данные незавершенного блока
+    const size_t readSize = 4 * 1024 * 1024;
+    string buff;
+    size_t pos = 0;
+    bool eof = false;
+    while (res)
+    {
+        if (!eof)
+        {
+            buff.erase(0, pos);
+            pos = 0;
+            size_t size = buff.size();
+            buff.resize(size + readSize);
+            size_t n = fread(&buff[size], 1, readSize, in);
+            buff.resize(size + n);
+            eof = (n == 0);
+        }
+        while (res && pos < buff.size())
+        {
+            // Уровень логирования сейвера определяет вид строки лога,  поэтому
+            // он извлекается из заголовка до разбора записей блока
+            if (buff.size() - pos >= SaverBinary::BlockHeader::Size)
+            {
+                uint8_t level;
+                memcpy(&level, buff.data() + pos + offsetof(SaverBinary::BlockHeader, level), 1);
+                layout = (level == Level::Debug2) ? LineLayout::Debug2 : LineLayout::Normal;
+            }
+            SaverBinary::ReadResult result =
+                SaverBinary::readBlock(buff.data() + pos, buff.size() - pos, header, writeLine);
+
+            if (result == SaverBinary::ReadResult::Ok)
+            {
+                pos += SaverBinary::BlockHeader::Size + header.size;
+                continue;
+            }
+            if (result == SaverBinary::ReadResult::Unsupported)
+            {
+                ++unsupported;
+                pos += SaverBinary::BlockHeader::Size + header.size;
+                continue;
+            }
+            if (result == SaverBinary::ReadResult::Incomplete && !eof)
+                break;
+
+            // Поврежденный блок (или незавершенный блок в конце файла): поиск
+            // начала следующего блока. Последние байты буфера сохраняются, так
+            // как они могут быть началом сигнатуры блока
+            ++corrupted;
+            size_t next = buff.find("ALB1", pos + 1);
+            if (next == string::npos)
+                next = (eof) ? buff.size() : std::max(pos + 1, buff.size() - 3);
+            pos = next;
+            if (!eof && pos >= buff.size() - 3)
+                break;
+        }
+        if (eof && pos >= buff.size())
+            break;
+    }
+
+    if (corrupted)
+        fprintf(stderr, "Corrupted blocks skipped: %llu\n", (unsigned long long)corrupted);
+
+    if (unsupported)
+        fprintf(stderr, "Compressed blocks skipped (build with LOGGER_USE_ZLIB): %llu\n",
+                (unsigned long long)unsupported);
+
+    fclose(in);
+    if (out != stdout)
+        fclose(out);
+
+    return (res) ? 0 : 1;
+}
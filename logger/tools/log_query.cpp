@@ -0,0 +1,280 @@
+/*****************************************************************************
+  Утилита выборки сообщений из лог-файла сейвера SaverFile. Лог-файл отобра-
+  жается в память, при наличии индекса (файл с расширением .idx,  см.  Saver-
+  File::indexInterval()) просматриваются только участки лог-файла, которые
+  могут содержать сообщения заданного интервала времени, уровня или модуля.
+  Участки лог-файла, не описанные индексом, просматриваются полностью.
+  Время задается в формате лог-файла: "YYYY.MM.DD hh:mm:ss"
+
+*****************************************************************************/
+
+// Команда для сборки
+// g++ -std=c++17 -O2 -DNDEBUG -I../.. log_query.cpp ../logger.cpp ../matchers.cpp ../utf8.cpp ../../thread/thread_base.cpp ../../thread/thread_utils.cpp -lpthread -o log_query
+
+#include "logger/logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace alog;
+
+namespace {
+
+// Длина метки времени в начале строки лог-файла
+const size_t timeSize = 19;
+
+struct Query
+{
+    string from;  // Границы интервала в формате лог-файла, пустая
+    string to;    // строка - граница не задана
+    int64_t fromTime = {0};
+    int64_t toTime = {INT64_MAX};
+    Level   level = {Level::Debug2};
+    string  module;
+    bool    moduleSet = {false};
+};
+
+// Преобразует время "YYYY.MM.DD hh:mm:ss" (локальное) в секунды от начала эпохи
+bool parseTime(const string& str, time_t& time)
+{
+    std::tm tm;
+    memset(&tm, 0, sizeof(tm));
+    if (str.size() != timeSize
+        || sscanf(str.c_str(), "%4d.%2d.%2d %2d:%2d:%2d", &tm.tm_year, &tm.tm_mon,
+                  &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6)
+        return false;
+
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    time = mktime(&tm);
+    return (time != time_t(-1));
+}
+
+bool isTimePrefix(const char* line, const char* end)
+{
+    static const char mask[] = "dddd.dd.dd dd:dd:dd";
+    if (size_t(end - line) < timeSize)
+        return false;
+
+    for (size_t i = 0; i < timeSize; ++i)
+    {
+        if (mask[i] == 'd' ? !isdigit((unsigned char)line[i]) : (line[i] != mask[i]))
+            return false;
+    }
+    return true;
+}
+
+// Проверяет строку лог-файла, начинающуюся с метки времени
+bool lineMatches(const char* line, const char* end, const Query& query)
+{
+    if (!query.from.empty() && memcmp(line, query.from.data(), timeSize) < 0)
+        return false;
+
+    if (!query.to.empty() && memcmp(line, query.to.data(), timeSize) > 0)
+        return false;
+
+    if (query.level == Level::Debug2 && !query.moduleSet)
+        return true;
+
+    // Пропускаем микросекунды (для уровня DEBUG2) и пробелы
+    const char* c = line + timeSize;
+    while (c < end && *c != ' ')
+        ++c;
+    while (c < end && *c == ' ')
+        ++c;
+
+    string level;
+    while (c < end && *c != ' ')
+        level += char(tolower((unsigned char)*c++));
+
+    if (levelFromString(level) > query.level)
+        return false;
+
+    if (!query.moduleSet)
+        return true;
+
+    // Формат: " LWP1234 [file:line Module] "
+    const char* open = (const char*)memchr(c, '[', size_t(end - c));
+    if (open == 0)
+        return query.module.empty();
+
+    const char* close = (const char*)memchr(open, ']', size_t(end - open));
+    if (close == 0)
+        return false;
+
+    const char* space = (const char*)memchr(open, ' ', size_t(close - open));
+    if (space == 0)
+        return query.module.empty();
+
+    return (size_t(close - space - 1) == query.module.size())
+           && (memcmp(space + 1, query.module.data(), query.module.size()) == 0);
+}
+
+bool entryMatches(const SaverFile::IndexEntry& entry, const Query& query,
+                  uint64_t moduleBit)
+{
+    if (entry.maxTime < query.fromTime || entry.minTime > query.toTime)
+        return false;
+
+    if (query.moduleSet && (entry.moduleMask & moduleBit) == 0)
+        return false;
+
+    for (int i = Level::Error; i <= int(query.level); ++i)
+        if (entry.levels[i])
+            return true;
+
+    return false;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr,
+                "Usage: %s LOG_FILE [-f FROM] [-t TO] [-l LEVEL] [-m MODULE]\n"
+                "  FROM, TO - time in format \"YYYY.MM.DD hh:mm:ss\"\n"
+                "  LEVEL    - error, warning, info, verbose, debug, debug2\n",
+                argv[0]);
+        return 1;
+    }
+
+    Query query;
+    for (int i = 2; i < argc - 1; i += 2)
+    {
+        string key = argv[i];
+        string value = argv[i + 1];
+        if (key == "-f" || key == "-t")
+        {
+            time_t time;
+            if (!parseTime(value, time))
+            {
+                fprintf(stderr, "Invalid time: %s\n", value.c_str());
+                return 1;
+            }
+            if (key == "-f")
+            {
+                query.from = value;
+                query.fromTime = int64_t(time) * 1000000000;
+            }
+            else
+            {
+                query.to = value;
+                query.toTime = (int64_t(time) + 1) * 1000000000 - 1;
+            }
+        }
+        else if (key == "-l")
+        {
+            query.level = levelFromString(value);
+        }
+        else if (key == "-m")
+        {
+            query.module = value;
+            query.moduleSet = true;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown parameter: %s\n", key.c_str());
+            return 1;
+        }
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    int fd = ::open(argv[1], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || ::fstat(fd, &st) != 0)
+    {
+        fprintf(stderr, "Could not open file: %s\n", argv[1]);
+        return 1;
+    }
+    uint64_t fileSize = uint64_t(st.st_size);
+    if (fileSize == 0)
+    {
+        ::close(fd);
+        return 0;
+    }
+
+    const char* data = (const char*)mmap(0, size_t(fileSize), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "Could not map file: %s\n", argv[1]);
+        return 1;
+    }
+
+    vector<SaverFile::IndexEntry> entries;
+    string error;
+    if (!SaverFile::readIndex(string(argv[1]) + ".idx", entries, error))
+        fprintf(stderr, "%s. Full scan of the log file\n", error.c_str());
+
+    // Участки лог-файла для просмотра: участки индекса, удовлетворяющие за-
+    // просу, и участки, не описанные индексом
+    vector<pair<uint64_t, uint64_t>> ranges;
+    auto addRange = [&ranges](uint64_t begin, uint64_t end)
+    {
+        if (begin >= end)
+            return;
+        if (!ranges.empty() && ranges.back().second == begin)
+            ranges.back().second = end;
+        else
+            ranges.push_back({begin, end});
+    };
+
+    uint64_t moduleBit = SaverFile::indexModuleBit(query.module.c_str());
+    uint64_t pos = 0;
+    for (const SaverFile::IndexEntry& entry : entries)
+    {
+        uint64_t entryEnd = entry.offset + entry.size;
+        if (entry.offset < pos || entryEnd > fileSize)
+            continue;
+
+        addRange(pos, entry.offset);
+        if (entryMatches(entry, query, moduleBit))
+            addRange(entry.offset, entryEnd);
+        pos = entryEnd;
+    }
+    addRange(pos, fileSize);
+
+    uint64_t scanned = 0;
+    bool res = true;
+    for (const pair<uint64_t, uint64_t>& range : ranges)
+    {
+        const char* it = data + range.first;
+        const char* end = data + range.second;
+        scanned += range.second - range.first;
+
+        // Строки без метки времени - продолжение многострочного сообщения
+        bool matched = false;
+        while (it < end && res)
+        {
+            const char* eol = (const char*)memchr(it, '\n', size_t(end - it));
+            const char* next = (eol) ? eol + 1 : end;
+            if (isTimePrefix(it, next))
+                matched = lineMatches(it, next, query);
+
+            if (matched)
+                res = (fwrite(it, 1, size_t(next - it), stdout) == size_t(next - it));
+            it = next;
+        }
+    }
+    munmap((void*)data, size_t(fileSize));
+
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "Scanned %llu of %llu bytes in %.3f ms\n",
+            (unsigned long long)scanned, (unsigned long long)fileSize, elapsed);
+
+    return (res) ? 0 : 1;
+}
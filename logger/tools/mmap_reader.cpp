@@ -0,0 +1,46 @@
+/*****************************************************************************
+  Утилита извлечения текста лога из файла сейвера SaverMmap. Выводит в stdout
+  (или в файл, указанный вторым параметром) действительные данные лог-файла,
+  в том числе после аварийного завершения процесса
+
+*****************************************************************************/
+
+// Команда для сборки
+// g++ -std=c++17 -O2 -DNDEBUG -I../.. mmap_reader.cpp ../logger.cpp ../matchers.cpp ../utf8.cpp ../../thread/thread_base.cpp ../../thread/thread_utils.cpp -lpthread -o mmap_reader
+
+#include "logger/logger.h"
+
+#include <cstdio>
+#include <string>
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s MMAP_LOG_FILE [OUTPUT_FILE]\n", argv[0]);
+        return 1;
+    }
+
+    string data;
+    string error;
+    if (!alog::SaverMmap::readFile(argv[1], data, error))
+    {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    FILE* out = (argc > 2) ? fopen(argv[2], "w") : stdout;
+    if (out == 0)
+    {
+        fprintf(stderr, "Could not open file: %s\n", argv[2]);
+        return 1;
+    }
+
+    bool res = (fwrite(data.data(), 1, data.size(), out) == data.size());
+    if (out != stdout)
+        fclose(out);
+
+    return (res) ? 0 : 1;
+}
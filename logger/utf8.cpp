@@ -0,0 +1,401 @@
+/* clang-format off */
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2026 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "logger/utf8.h"
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef ALOG_UTF8_SIMD
+#include <immintrin.h>
+#endif
+
+namespace alog {
+namespace detail {
+
+namespace {
+
+inline bool utf8Continuation(unsigned char c)
+{
+    return (c & 0xC0) == 0x80;
+}
+
+// Проверяет UTF-8 последовательность в начале текста. Возвращает длину кор-
+// ректной последовательности, или 0 если последовательность некорректна,
+// в этом случае в параметре invalid возвращается длина некорректного фраг-
+// мента (максимальная корректная часть последовательности, но не менее 1)
+size_t utf8Sequence(const unsigned char* p, size_t size, size_t& invalid)
+{
+    unsigned char c = p[0];
+    if (c < 0x80)
+        return 1;
+
+    size_t len;
+    unsigned char lo = 0x80, hi = 0xBF; // Допустимый диапазон второго байта
+    if (c >= 0xC2 && c <= 0xDF)
+        len = 2;
+    else if (c >= 0xE0 && c <= 0xEF)
+    {
+        len = 3;
+        if (c == 0xE0) lo = 0xA0; // Избыточное кодирование
+        if (c == 0xED) hi = 0x9F; // Суррогаты
+    }
+    else if (c >= 0xF0 && c <= 0xF4)
+    {
+        len = 4;
+        if (c == 0xF0) lo = 0x90; // Избыточное кодирование
+        if (c == 0xF4) hi = 0x8F; // Больше U+10FFFF
+    }
+    else
+    {
+        invalid = 1;
+        return 0;
+    }
+
+    size_t i = 1;
+    for (; i < len && i < size; ++i)
+    {
+        unsigned char b = p[i];
+        if ((i == 1) ? (b < lo || b > hi) : !utf8Continuation(b))
+            break;
+    }
+    if (i == len)
+        return len;
+
+    invalid = i;
+    return 0;
+}
+
+} // namespace
+
+bool utf8ValidScalar(const unsigned char* p, size_t size)
+{
+    size_t i = 0;
+    while (i < size)
+    {
+        // Быстрый пропуск ASCII символов
+        if (p[i] < 0x80)
+        {
+            ++i;
+            continue;
+        }
+        size_t invalid;
+        size_t len = utf8Sequence(p + i, size - i, invalid);
+        if (len == 0)
+            return false;
+        i += len;
+    }
+    return true;
+}
+
+#ifdef ALOG_UTF8_SIMD
+/**
+  Векторная проверка UTF-8 по таблицам (алгоритм J.Keiser, D.Lemire "Valida-
+  ting UTF-8 In Less Than One Instruction Per Byte"). Для каждой пары сосед-
+  них байт по старшим и младшим полубайтам первого байта и старшему полубайту
+  второго байта выбираются маски возможных ошибок, пересечение масок дает
+  ошибки пары. Отдельно проверяются байты продолжения 3- и 4-байтовых после-
+  довательностей и незавершенная последовательность в конце текста
+*/
+namespace {
+enum : uint8_t
+{
+    TooShort     = 1 << 0, // 11______ 0_______, 11______ 11______
+    TooLong      = 1 << 1, // 0_______ 10______
+    Overlong3    = 1 << 2, // 11100000 100_____
+    TooLarge     = 1 << 3, // 11110100 1001____, 11110100 101_____,
+                           // 11110101..11111111 10______
+    Surrogate    = 1 << 4, // 11101101 101_____
+    Overlong2    = 1 << 5, // 1100000_ 10______
+    TooLarge1000 = 1 << 6, // 11110101..11111111 1000____
+    Overlong4    = 1 << 6, // 11110000 1000____
+    TwoConts     = 1 << 7, // 10______ 10______
+    Carry        = TooShort | TooLong | TwoConts
+};
+} // namespace
+
+#define ALOG_UTF8_BYTE1_HIGH \
+    TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, \
+    TwoConts, TwoConts, TwoConts, TwoConts, \
+    TooShort | Overlong2, \
+    TooShort, \
+    TooShort | Overlong3 | Surrogate, \
+    TooShort | TooLarge | TooLarge1000 | Overlong4
+
+#define ALOG_UTF8_BYTE1_LOW \
+    Carry | Overlong3 | Overlong2 | Overlong4, \
+    Carry | Overlong2, \
+    Carry, \
+    Carry, \
+    Carry | TooLarge, \
+    Carry | TooLarge | TooLarge1000, \
+    Carry | TooLarge | TooLarge1000, \
+    Carry | TooLarge | TooLarge1000, \
+    Carry | TooLarge | TooLarge1000, \
+    Carry | TooLarge | TooLarge1000, \
+    Carry | TooLarge | TooLarge1000, \
+    Carry | TooLarge | TooLarge1000, \
+    Carry | TooLarge | TooLarge1000, \
+    Carry | TooLarge | TooLarge1000 | Surrogate, \
+    Carry | TooLarge | TooLarge1000, \
+    Carry | TooLarge | TooLarge1000
+
+#define ALOG_UTF8_BYTE2_HIGH \
+    TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, \
+    TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge1000 | Overlong4, \
+    TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge, \
+    TooLong | Overlong2 | TwoConts | Surrogate | TooLarge, \
+    TooLong | Overlong2 | TwoConts | Surrogate | TooLarge, \
+    TooShort, TooShort, TooShort, TooShort
+
+#define ALOG_UTF8_INCOMPLETE \
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, \
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, char(0xF0 - 1), char(0xE0 - 1), char(0xC0 - 1)
+
+__attribute__((target("ssse3")))
+bool utf8ValidSsse3(const unsigned char* p, size_t size)
+{
+    const __m128i byte1High  = _mm_setr_epi8(ALOG_UTF8_BYTE1_HIGH);
+    const __m128i byte1Low   = _mm_setr_epi8(ALOG_UTF8_BYTE1_LOW);
+    const __m128i byte2High  = _mm_setr_epi8(ALOG_UTF8_BYTE2_HIGH);
+    const __m128i incomplete = _mm_setr_epi8(ALOG_UTF8_INCOMPLETE);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i third  = _mm_set1_epi8(char(0xE0 - 0x80));
+    const __m128i fourth = _mm_set1_epi8(char(0xF0 - 0x80));
+    const __m128i high   = _mm_set1_epi8(char(0x80));
+
+    __m128i prevInput = _mm_setzero_si128();
+    __m128i prevIncomplete = _mm_setzero_si128();
+    __m128i error = _mm_setzero_si128();
+
+    for (size_t i = 0; i < size; i += 16)
+    {
+        __m128i input;
+        if (size - i >= 16)
+        {
+            input = _mm_loadu_si128((const __m128i*)(p + i));
+        }
+        else
+        {
+            // Последний блок дополняется нулями (ASCII)
+            unsigned char buff[16] = {0};
+            memcpy(buff, p + i, size - i);
+            input = _mm_loadu_si128((const __m128i*)buff);
+        }
+
+        if (_mm_movemask_epi8(input) == 0)
+        {
+            // Блок из ASCII символов: проверяется только незавершенная после-
+            // довательность в конце предыдущего блока
+            error = _mm_or_si128(error, prevIncomplete);
+            prevIncomplete = _mm_setzero_si128();
+            prevInput = input;
+            continue;
+        }
+
+        __m128i prev1 = _mm_alignr_epi8(input, prevInput, 15);
+        __m128i prev2 = _mm_alignr_epi8(input, prevInput, 14);
+        __m128i prev3 = _mm_alignr_epi8(input, prevInput, 13);
+
+        __m128i b1h = _mm_shuffle_epi8(byte1High, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+        __m128i b1l = _mm_shuffle_epi8(byte1Low, _mm_and_si128(prev1, nibble));
+        __m128i b2h = _mm_shuffle_epi8(byte2High, _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+        __m128i special = _mm_and_si128(_mm_and_si128(b1h, b1l), b2h);
+
+        __m128i must23 = _mm_or_si128(_mm_subs_epu8(prev2, third), _mm_subs_epu8(prev3, fourth));
+        must23 = _mm_and_si128(must23, high);
+        error = _mm_or_si128(error, _mm_xor_si128(must23, special));
+
+        prevIncomplete = _mm_subs_epu8(input, incomplete);
+        prevInput = input;
+    }
+    error = _mm_or_si128(error, prevIncomplete);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+}
+
+__attribute__((target("avx2")))
+bool utf8ValidAvx2(const unsigned char* p, size_t size)
+{
+    const __m256i byte1High  = _mm256_setr_epi8(ALOG_UTF8_BYTE1_HIGH, ALOG_UTF8_BYTE1_HIGH);
+    const __m256i byte1Low   = _mm256_setr_epi8(ALOG_UTF8_BYTE1_LOW, ALOG_UTF8_BYTE1_LOW);
+    const __m256i byte2High  = _mm256_setr_epi8(ALOG_UTF8_BYTE2_HIGH, ALOG_UTF8_BYTE2_HIGH);
+    const __m256i incomplete = _mm256_setr_epi8(
+        char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF),
+        char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF),
+        ALOG_UTF8_INCOMPLETE);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i third  = _mm256_set1_epi8(char(0xE0 - 0x80));
+    const __m256i fourth = _mm256_set1_epi8(char(0xF0 - 0x80));
+    const __m256i high   = _mm256_set1_epi8(char(0x80));
+
+    __m256i prevInput = _mm256_setzero_si256();
+    __m256i prevIncomplete = _mm256_setzero_si256();
+    __m256i error = _mm256_setzero_si256();
+
+    for (size_t i = 0; i < size; i += 32)
+    {
+        __m256i input;
+        if (size - i >= 32)
+        {
+            input = _mm256_loadu_si256((const __m256i*)(p + i));
+        }
+        else
+        {
+            unsigned char buff[32] = {0};
+            memcpy(buff, p + i, size - i);
+            input = _mm256_loadu_si256((const __m256i*)buff);
+        }
+
+        if (_mm256_movemask_epi8(input) == 0)
+        {
+            error = _mm256_or_si256(error, prevIncomplete);
+            prevIncomplete = _mm256_setzero_si256();
+            prevInput = input;
+            continue;
+        }
+
+        // Сдвиг на N байт через границу 128-битных половин регистра
+        __m256i shifted = _mm256_permute2x128_si256(prevInput, input, 0x21);
+        __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+        __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+        __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+
+        __m256i b1h = _mm256_shuffle_epi8(byte1High, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+        __m256i b1l = _mm256_shuffle_epi8(byte1Low, _mm256_and_si256(prev1, nibble));
+        __m256i b2h = _mm256_shuffle_epi8(byte2High, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+        __m256i special = _mm256_and_si256(_mm256_and_si256(b1h, b1l), b2h);
+
+        __m256i must23 = _mm256_or_si256(_mm256_subs_epu8(prev2, third), _mm256_subs_epu8(prev3, fourth));
+        must23 = _mm256_and_si256(must23, high);
+        error = _mm256_or_si256(error, _mm256_xor_si256(must23, special));
+
+        prevIncomplete = _mm256_subs_epu8(input, incomplete);
+        prevInput = input;
+    }
+    error = _mm256_or_si256(error, prevIncomplete);
+    return _mm256_testz_si256(error, error) != 0;
+}
+
+#undef ALOG_UTF8_BYTE1_HIGH
+#undef ALOG_UTF8_BYTE1_LOW
+#undef ALOG_UTF8_BYTE2_HIGH
+#undef ALOG_UTF8_INCOMPLETE
+#endif // ALOG_UTF8_SIMD
+
+bool utf8SimdSupported(Utf8Simd simd)
+{
+#ifdef ALOG_UTF8_SIMD
+    __builtin_cpu_init();
+    switch (simd)
+    {
+        case Utf8Simd::Ssse3: return __builtin_cpu_supports("ssse3");
+        case Utf8Simd::Avx2:  return __builtin_cpu_supports("avx2");
+    }
+#endif
+    (void) simd;
+    return false;
+}
+
+namespace {
+
+typedef bool (*Utf8ValidFunc)(const unsigned char*, size_t);
+
+Utf8ValidFunc utf8ValidSelect()
+{
+#ifdef ALOG_UTF8_SIMD
+    if (utf8SimdSupported(Utf8Simd::Avx2))
+        return utf8ValidAvx2;
+    if (utf8SimdSupported(Utf8Simd::Ssse3))
+        return utf8ValidSsse3;
+#endif
+    return utf8ValidScalar;
+}
+
+} // namespace
+
+bool utf8Valid(const char* text, size_t size)
+{
+    static const Utf8ValidFunc func = utf8ValidSelect();
+
+    // Для коротких строк векторная проверка не дает выигрыша
+    if (size < 16)
+        return utf8ValidScalar((const unsigned char*)text, size);
+
+    return func((const unsigned char*)text, size);
+}
+
+size_t utf8Sanitize(const char* text, size_t size, string& out)
+{
+    static const char replacement[] = "\xEF\xBF\xBD"; // U+FFFD
+
+    const unsigned char* p = (const unsigned char*)text;
+    size_t replaced = 0;
+    size_t begin = 0; // Начало корректного фрагмента, еще не скопированного в out
+    size_t i = 0;
+
+    out.reserve(out.size() + size + 16);
+    while (i < size)
+    {
+        if (p[i] < 0x80)
+        {
+            ++i;
+            continue;
+        }
+        size_t invalid;
+        size_t len = utf8Sequence(p + i, size - i, invalid);
+        if (len)
+        {
+            i += len;
+            continue;
+        }
+        out.append(text + begin, i - begin);
+        out.append(replacement, sizeof(replacement) - 1);
+        ++replaced;
+        i += invalid;
+        begin = i;
+    }
+    out.append(text + begin, size - begin);
+    return replaced;
+}
+
+size_t utf8CropSize(const char* text, size_t size, size_t maxSize, bool& error)
+{
+    error = false;
+    if (maxSize >= size)
+        return size;
+
+    // Граница символа ищется не далее трех байт продолжения от позиции обрезки
+    const unsigned char* p = (const unsigned char*)text;
+    size_t pos = maxSize;
+    while (pos > 0 && (maxSize - pos) < 3 && utf8Continuation(p[pos]))
+        --pos;
+
+    error = (pos == 0) || utf8Continuation(p[pos]);
+    return (error) ? maxSize : pos;
+}
+
+} // namespace detail
+} // namespace alog
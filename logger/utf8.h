@@ -0,0 +1,79 @@
+/* clang-format off */
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2026 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Проверка и исправление UTF-8 текста лог-сообщений.
+
+*****************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#if (defined(__GNUC__) || defined(__clang__)) \
+    && (defined(__x86_64__) || defined(__i386__))
+#define ALOG_UTF8_SIMD
+#endif
+
+namespace alog {
+namespace detail {
+
+using namespace std;
+
+// Возвращает TRUE если текст является корректной UTF-8 последовательностью.
+// Для процессоров x86 с поддержкой AVX2 или SSSE3 проверка выполняется векторными
+// инструкциями (выбор реализации выполняется при первом вызове), для остальных
+// процессоров - побайтно
+bool utf8Valid(const char* text, size_t size);
+inline bool utf8Valid(const string& text) {return utf8Valid(text.c_str(), text.size());}
+
+// Копирует текст в out, заменяя каждую некорректную UTF-8 последовательность
+// символом U+FFFD. Возвращает количество выполненных замен
+size_t utf8Sanitize(const char* text, size_t size, string& out);
+
+// Возвращает длину текста, обрезанного до maxSize байт по границе UTF-8 сим-
+// вола. Если граница символа не найдена (текст некорректен), то возвращается
+// maxSize, а параметр error устанавливается в TRUE
+size_t utf8CropSize(const char* text, size_t size, size_t maxSize, bool& error);
+
+// Реализации проверки UTF-8, из которых utf8Valid() выбирает подходящую для
+// процессора. Функции вынесены в заголовок для модульных тестов. Векторные
+// реализации можно вызывать только если utf8SimdSupported() вернула TRUE
+enum class Utf8Simd
+{
+    Ssse3 = 0,
+    Avx2  = 1
+};
+bool utf8SimdSupported(Utf8Simd);
+
+bool utf8ValidScalar(const unsigned char* p, size_t size);
+#ifdef ALOG_UTF8_SIMD
+bool utf8ValidSsse3(const unsigned char* p, size_t size);
+bool utf8ValidAvx2(const unsigned char* p, size_t size);
+#endif
+
+} // namespace detail
+} // namespace alog
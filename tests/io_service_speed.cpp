@@ -0,0 +1,121 @@
+/*****************************************************************************
+  Сравнение скорости записи пакетов строк в файл:
+    - fputs() для каждой строки и fflush() после пакета (исходный механизм
+      записи SaverFile);
+    - trd::IoService с механизмом io_uring;
+    - trd::IoService с механизмом pwritev() в отдельном потоке.
+  Для каждого варианта измеряется время, в течение которого блокируется
+  вызывающий поток (submit), и полное время записи всех пакетов (total)
+
+*****************************************************************************/
+
+// Команда для сборки
+// g++ -std=c++11 -O2 -DNDEBUG -I.. io_service_speed.cpp ../thread/io_service.cpp -lpthread -o io_service_speed
+
+#include "steady_timer.h"
+#include "thread/io_service.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+const char* filePath = "/tmp/io_service_speed.log";
+
+void printResult(const char* name, int64_t submitTime, int64_t totalTime, size_t bytes)
+{
+    printf("%-16s submit: %9.3f ms; total: %9.3f ms (%7.1f MB/s)\n",
+           name, submitTime / 1000.0, totalTime / 1000.0,
+           double(bytes) / max<int64_t>(totalTime, 1));
+}
+
+void fputsTest(const vector<string>& lines, int batchCount)
+{
+    FILE* f = fopen(filePath, "w");
+    if (f == 0)
+    {
+        printf("Could not open file %s\n", filePath);
+        return;
+    }
+
+    size_t bytes = 0;
+    steady_timer timer;
+    for (int i = 0; i < batchCount; ++i)
+    {
+        for (const string& line : lines)
+        {
+            fputs(line.c_str(), f);
+            bytes += line.size();
+        }
+        fflush(f);
+    }
+    int64_t submitTime = timer.elapsed<chrono::microseconds>();
+    fclose(f);
+
+    printResult("fputs/fflush", submitTime, timer.elapsed<chrono::microseconds>(), bytes);
+}
+
+void ioServiceTest(const vector<string>& lines, int batchCount, bool useIoUring)
+{
+    trd::IoService ioService;
+    ioService.start(useIoUring);
+    if (useIoUring && ioService.backend() != trd::IoService::Backend::IoUring)
+    {
+        printf("%-16s not available\n", "io_uring");
+        return;
+    }
+
+    int fd = ::open(filePath, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0)
+    {
+        printf("Could not open file %s\n", filePath);
+        return;
+    }
+    int fileId = ioService.registerFile(fd);
+
+    size_t bytes = 0;
+    steady_timer timer;
+    for (int i = 0; i < batchCount; ++i)
+    {
+        // Пакет копируется в один буфер, так же как это делает SaverFile
+        string buff;
+        for (const string& line : lines)
+            buff += line;
+
+        bytes += buff.size();
+        ioService.append(fileId, std::move(buff));
+    }
+    int64_t submitTime = timer.elapsed<chrono::microseconds>();
+
+    ioService.releaseFile(fileId, true);
+    ioService.wait();
+
+    printResult((useIoUring) ? "io_uring" : "pwritev thread",
+                submitTime, timer.elapsed<chrono::microseconds>(), bytes);
+    ioService.stop();
+}
+
+int main(int argc, char* argv[])
+{
+    // Количество пакетов
+    int batchCount = (argc > 1) ? atoi(argv[1]) : 20000;
+
+    // Количество строк в пакете
+    int batchSize = (argc > 2) ? atoi(argv[2]) : 50;
+
+    vector<string> lines;
+    for (int i = 0; i < batchSize; ++i)
+        lines.push_back("2026.01.01 12:00:00 DEBUG   LWP12345 [io_service_speed.cpp:99] "
+                        "Message " + to_string(i) + "\n");
+
+    fputsTest(lines, batchCount);
+    ioServiceTest(lines, batchCount, true);
+    ioServiceTest(lines, batchCount, false);
+
+    ::remove(filePath);
+    return 0;
+}
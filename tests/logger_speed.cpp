@@ -0,0 +1,93 @@
+/*****************************************************************************
+  Тест на конкурентную запись лог-сообщений из большого количества потоков.
+  Измеряется пропускная способность функции Logger::addMessage() (через
+  вызовы log_debug) при различном количестве потоков-производителей
+
+*****************************************************************************/
+
+// Команда для сборки
+// g++ -std=c++17 -O2 -DNDEBUG -I.. logger_speed.cpp ../logger/logger.cpp ../logger/matchers.cpp ../logger/utf8.cpp ../thread/thread_base.cpp ../thread/thread_utils.cpp -lpthread -o logger_speed
+
+#include "steady_timer.h"
+#include "logger/logger.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace alog;
+
+/**
+  Сейвер-заглушка, подсчитывает количество полученных сообщений
+*/
+class SaverCount : public Saver
+{
+public:
+    SaverCount(const string& name, Level level) : Saver(name, level)
+    {}
+    void flushImpl(const MessageList& messages) override
+    {
+        count += messages.count();
+    }
+    atomic<long> count = {0};
+};
+typedef clife_ptr<SaverCount> SaverCountPtr;
+
+int main(int argc, char* argv[])
+{
+    // Количество сообщений, записываемых каждым потоком
+    int messagesCount = (argc > 1) ? atoi(argv[1]) : 200000;
+
+    // Максимальное количество потоков-производителей
+    int maxThreads = (argc > 2) ? atoi(argv[2]) : 32;
+
+    logger().start();
+
+    SaverCountPtr saver {new SaverCount("count", Level::Debug)};
+    logger().addSaver(saver);
+
+    for (int threadsCount = 1; threadsCount <= maxThreads; threadsCount *= 2)
+    {
+        logger().flush();
+        logger().waitingFlush();
+        saver->count = 0;
+
+        atomic_bool start = {false};
+        vector<thread> threads;
+        for (int i = 0; i < threadsCount; ++i)
+            threads.push_back(thread([&start, messagesCount]()
+            {
+                while (!start) {}
+                for (int j = 0; j < messagesCount; ++j)
+                    log_debug << "Message " << j;
+            }));
+
+        steady_timer timer;
+        start = true;
+
+        for (thread& t : threads)
+            t.join();
+
+        int64_t enqueueTime = timer.elapsed<chrono::microseconds>();
+
+        long total = long(threadsCount) * messagesCount;
+        while (saver->count < total)
+        {
+            logger().flush();
+            this_thread::sleep_for(chrono::milliseconds(5));
+        }
+        int64_t totalTime = timer.elapsed<chrono::microseconds>();
+
+        printf("threads: %2d; messages: %9ld; enqueue: %8.3f ms (%6.2f Mmsg/s); "
+               "flushed: %8.3f ms\n",
+               threadsCount, total,
+               enqueueTime / 1000.0, double(total) / max<int64_t>(enqueueTime, 1),
+               totalTime / 1000.0);
+    }
+
+    alog::stop();
+    return 0;
+}
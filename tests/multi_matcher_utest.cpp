@@ -0,0 +1,181 @@
+/* clang-format off */
+
+// Команда для сборки
+// g++ -std=c++17 -ggdb3 -I.. multi_matcher_utest.cpp ../logger/matchers.cpp
+//     -o multi_matcher_utest
+
+#include "logger/matchers.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using alog::detail::MultiMatcher;
+
+int failCount = 0;
+
+void check(bool b, const char* descr)
+{
+    printf("%-60s : %s\n", descr, (b) ? "OK" : "FAIL");
+    if (!b)
+        ++failCount;
+}
+
+bool match(const vector<string>& patterns, const string& text)
+{
+    MultiMatcher matcher;
+    matcher.compile(patterns);
+    return matcher.match(text);
+}
+
+// Эталонная реализация: последовательный поиск каждой подстроки
+bool naiveMatch(const vector<string>& patterns, const string& text)
+{
+    for (const string& pattern : patterns)
+        if (text.find(pattern) != string::npos)
+            return true;
+    return false;
+}
+
+void basic_Test()
+{
+    printf("\n=== Basic Test ===\n");
+
+    const vector<string> words {"he", "she", "his", "hers"};
+    check( match(words, "ushers"),              "{he,she,his,hers} ~ 'ushers'");
+    check( match(words, "ahis"),                "{he,she,his,hers} ~ 'ahis'");
+    check(!match(words, "hi, sh!"),             "{he,she,his,hers} !~ 'hi, sh!'");
+
+    // Одна подстрока является суффиксом или частью другой
+    check( match({"abcd", "bc"}, "xabcx"),      "{abcd,bc} ~ 'xabcx'");
+    check( match({"abcd", "cd"}, "abcd"),       "{abcd,cd} ~ 'abcd'");
+    check(!match({"abcd", "bce"}, "abcbcd"),    "{abcd,bce} !~ 'abcbcd'");
+
+    // Переходы по суффиксным ссылкам
+    check( match({"aab"}, "aaab"),              "{aab} ~ 'aaab'");
+    check( match({"abab"}, "abaabab"),          "{abab} ~ 'abaabab'");
+    check(!match({"abab"}, "abaaba"),           "{abab} !~ 'abaaba'");
+    check( match({"aaaa", "ab"}, "aaab"),       "{aaaa,ab} ~ 'aaab'");
+
+    // Совпадения на границах текста
+    check( match({"abc"}, "abc"),               "{abc} ~ 'abc' (whole text)");
+    check( match({"abc"}, "abcxxxx"),           "{abc} ~ 'abcxxxx' (begin)");
+    check( match({"abc"}, "xxxxabc"),           "{abc} ~ 'xxxxabc' (end)");
+    check(!match({"abc"}, "xxxxab"),            "{abc} !~ 'xxxxab' (truncated at end)");
+    check( match({"x", "abc"}, "yyyyx"),        "{x,abc} ~ 'yyyyx' (last byte)");
+    check(!match({"abc"}, ""),                  "{abc} !~ ''");
+    check(!match({"abc"}, "ab"),                "{abc} !~ 'ab' (text shorter)");
+
+    // Бинарные данные
+    check( match({string("a\0b", 3)}, string("xa\0bx", 5)), "{'a\\0b'} ~ 'xa\\0bx'");
+    check(!match({string("a\0b", 3)}, "ab"),    "{'a\\0b'} !~ 'ab'");
+    check( match({"\xff\xfe"}, "ab\xff\xfe"),   "{'\\xff\\xfe'} ~ 'ab\\xff\\xfe'");
+}
+
+void empty_Test()
+{
+    printf("\n=== Empty/Duplicate Test ===\n");
+
+    MultiMatcher matcher;
+    check( matcher.empty(),                     "default matcher is empty");
+    check(!matcher.match("abc"),                "default matcher !~ 'abc'");
+
+    matcher.compile({});
+    check( matcher.empty(),                     "compile({}) is empty");
+    check(!matcher.match(""),                   "compile({}) !~ ''");
+
+    // Пустая подстрока содержится в любом тексте
+    check( match({""}, ""),                     "{''} ~ ''");
+    check( match({""}, "abc"),                  "{''} ~ 'abc'");
+    check( match({"xyz", ""}, "abc"),           "{xyz,''} ~ 'abc'");
+
+    // Повторяющиеся подстроки
+    check( match({"abc", "abc"}, "xabcx"),      "{abc,abc} ~ 'xabcx'");
+    check(!match({"abc", "abc"}, "xabx"),       "{abc,abc} !~ 'xabx'");
+
+    // Повторная компиляция заменяет автомат
+    matcher.compile({"abc"});
+    check( matcher.match("abc"),                "recompile: {abc} ~ 'abc'");
+    matcher.compile({"xyz"});
+    check(!matcher.match("abc"),                "recompile: {xyz} !~ 'abc'");
+    check( matcher.match("xyz"),                "recompile: {xyz} ~ 'xyz'");
+}
+
+void classes_Test()
+{
+    printf("\n=== Character Classes Test ===\n");
+
+    // Подстроки, содержащие все 256 значений байта (классы символов не
+    // сжимаются)
+    vector<string> patterns;
+    for (int c = 0; c < 256; c += 2)
+        patterns.push_back(string{char(c), char(c + 1), char(c)});
+
+    check( match(patterns, string{'z', char(0xfe), char(0xff), char(0xfe)}),
+          "256 classes: match at end");
+    check(!match(patterns, string{char(0xfe), char(0xff), char(0xfd)}),
+          "256 classes: no match");
+}
+
+void random_Test()
+{
+    printf("\n=== Random Test (cross-check with std::string::find) ===\n");
+
+    std::mt19937 rnd {12345};
+    auto randomString = [&rnd](size_t maxLen, int alphabet)
+    {
+        string s(rnd() % (maxLen + 1), ' ');
+        for (char& c : s)
+            c = char('a' + rnd() % alphabet);
+        return s;
+    };
+
+    int mismatches = 0;
+    int matches = 0;
+    for (int i = 0; i < 20000; ++i)
+    {
+        // Малый алфавит дает много пересекающихся подстрок
+        int alphabet = 2 + int(rnd() % 3);
+
+        vector<string> patterns;
+        size_t count = 1 + rnd() % 6;
+        for (size_t j = 0; j < count; ++j)
+            patterns.push_back(randomString(6, alphabet));
+
+        MultiMatcher matcher;
+        matcher.compile(patterns);
+
+        for (int j = 0; j < 10; ++j)
+        {
+            string text = randomString(40, alphabet);
+            bool res = matcher.match(text);
+            if (res != naiveMatch(patterns, text))
+            {
+                if (mismatches++ < 10)
+                    printf("  mismatch: text '%s'\n", text.c_str());
+            }
+            matches += int(res);
+        }
+    }
+    printf("  matched texts: %d of 200000\n", matches);
+    check(mismatches == 0, "random patterns cross-check");
+}
+
+int main()
+{
+    basic_Test();
+    empty_Test();
+    classes_Test();
+    random_Test();
+
+    if (failCount)
+    {
+        printf("\nFailed: %d\n", failCount);
+        exit(1);
+    }
+    printf("\nAll tests passed\n");
+    return 0;
+}
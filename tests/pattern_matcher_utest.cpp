@@ -0,0 +1,222 @@
+/* clang-format off */
+
+// Команда для сборки
+// g++ -std=c++17 -ggdb3 -I.. pattern_matcher_utest.cpp ../logger/config.cpp
+//     ../logger/logger.cpp ../logger/matchers.cpp ../logger/utf8.cpp
+//     ../thread/thread_base.cpp ../thread/thread_utils.cpp ../thread/thread_pool.cpp
+//     -lyaml-cpp -lpthread -o pattern_matcher_utest
+
+#include "logger/config.h"
+#include "logger/matchers.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace alog;
+using alog::detail::PatternMatcher;
+
+typedef PatternMatcher::Syntax Syntax;
+
+int failCount = 0;
+
+void check(bool b, const char* descr)
+{
+    printf("%-60s : %s\n", descr, (b) ? "OK" : "FAIL");
+    if (!b)
+        ++failCount;
+}
+
+bool match(const vector<string>& patterns, Syntax syntax, const string& text)
+{
+    PatternMatcher matcher;
+    string error;
+    if (!matcher.compile(patterns, syntax, &error))
+    {
+        printf("Compile error: %s\n", error.c_str());
+        exit(1);
+    }
+    return matcher.match(text);
+}
+
+bool glob(const string& pattern, const string& text)
+{
+    return match({pattern}, Syntax::Glob, text);
+}
+
+bool regex(const string& pattern, const string& text)
+{
+    return match({pattern}, Syntax::Regex, text);
+}
+
+bool invalid(const string& pattern, Syntax syntax)
+{
+    string error;
+    bool res = !PatternMatcher::check(pattern, syntax, &error);
+    if (res)
+        printf("  '%s' -> %s\n", pattern.c_str(), error.c_str());
+    return res;
+}
+
+void glob_Test()
+{
+    printf("\n=== Glob Test ===\n");
+
+    check( glob("*.cpp", "logger.cpp"),         "'*.cpp' ~ 'logger.cpp'");
+    check(!glob("*.cpp", "logger.cpp.bak"),     "'*.cpp' !~ 'logger.cpp.bak' (whole text)");
+    check(!glob("logger", "logger.cpp"),        "'logger' !~ 'logger.cpp' (whole text)");
+    check( glob("*", ""),                       "'*' ~ ''");
+    check(!glob("?", ""),                       "'?' !~ ''");
+    check( glob("a?c", "abc"),                  "'a?c' ~ 'abc'");
+    check(!glob("a?c", "ac"),                   "'a?c' !~ 'ac'");
+    check( glob("[a-c]x", "bx"),                "'[a-c]x' ~ 'bx'");
+    check(!glob("[a-c]x", "dx"),                "'[a-c]x' !~ 'dx'");
+    check( glob("[!a-c]x", "dx"),               "'[!a-c]x' ~ 'dx'");
+    check(!glob("[!a-c]x", "ax"),               "'[!a-c]x' !~ 'ax'");
+    check( glob("[abc]*", "cat"),               "'[abc]*' ~ 'cat'");
+    check( glob("a\\*b", "a*b"),                "'a\\*b' ~ 'a*b'");
+    check(!glob("a\\*b", "axb"),                "'a\\*b' !~ 'axb'");
+    check( glob("Net*Intf", "NetIntf"),         "'Net*Intf' ~ 'NetIntf'");
+    check( glob("*a*b*", "xxaxxbxx"),           "'*a*b*' ~ 'xxaxxbxx'");
+    check( glob("a*", "a\nb"),                  "'a*' ~ 'a\\nb' ('*' matches '\\n')");
+    check( match({"*.h", "*.cpp"}, Syntax::Glob, "a.h"),   "{'*.h','*.cpp'} ~ 'a.h'");
+    check( match({"*.h", "*.cpp"}, Syntax::Glob, "a.cpp"), "{'*.h','*.cpp'} ~ 'a.cpp'");
+    check(!match({"*.h", "*.cpp"}, Syntax::Glob, "a.c"),   "{'*.h','*.cpp'} !~ 'a.c'");
+
+    check( invalid("[abc", Syntax::Glob),       "'[abc' is invalid glob");
+}
+
+void regex_Test()
+{
+    printf("\n=== Regex Test ===\n");
+
+    // Поиск в любом месте текста
+    check( regex("abc", "xxabcxx"),             "'abc' ~ 'xxabcxx'");
+    check(!regex("abd", "xxabcxx"),             "'abd' !~ 'xxabcxx'");
+    check( regex("", "anything"),               "'' ~ 'anything'");
+
+    // Привязки
+    check( regex("^abc", "abcxx"),              "'^abc' ~ 'abcxx'");
+    check(!regex("^abc", "xabc"),               "'^abc' !~ 'xabc'");
+    check( regex("abc$", "xxabc"),              "'abc$' ~ 'xxabc'");
+    check(!regex("abc$", "abcx"),               "'abc$' !~ 'abcx'");
+    check( regex("^$", ""),                     "'^$' ~ ''");
+    check(!regex("^a$", "a\n"),                 "'^a$' !~ 'a\\n' (no multiline)");
+
+    // Любой символ
+    check( regex("a.c", "abc"),                 "'a.c' ~ 'abc'");
+    check(!regex("a.c", "a\nc"),                "'a.c' !~ 'a\\nc' ('.' excludes '\\n')");
+    check( regex("a.c", "a\tc"),                "'a.c' ~ 'a\\tc'");
+
+    // Классы символов
+    check( regex("^\\d+$", "12345"),            "'^\\d+$' ~ '12345'");
+    check(!regex("^\\d+$", "123a5"),            "'^\\d+$' !~ '123a5'");
+    check( regex("^\\D+$", "abc"),              "'^\\D+$' ~ 'abc'");
+    check( regex("^\\w+$", "a_Z9"),             "'^\\w+$' ~ 'a_Z9'");
+    check(!regex("^\\w+$", "a-b"),              "'^\\w+$' !~ 'a-b'");
+    check( regex("^\\W$", "-"),                 "'^\\W$' ~ '-'");
+    check( regex("a\\sb", "a\tb"),              "'a\\sb' ~ 'a\\tb'");
+    check(!regex("a\\Sb", "a b"),               "'a\\Sb' !~ 'a b'");
+    check( regex("^[a-f0-9]+$", "deadbeef"),    "'^[a-f0-9]+$' ~ 'deadbeef'");
+    check(!regex("^[^0-9]+$", "ab1"),           "'^[^0-9]+$' !~ 'ab1'");
+    check( regex("^[\\d.]+$", "1.5"),           "'^[\\d.]+$' ~ '1.5'");
+    check( regex("a\\.b", "a.b"),               "'a\\.b' ~ 'a.b'");
+    check(!regex("a\\.b", "axb"),               "'a\\.b' !~ 'axb'");
+
+    // Альтернативы и группы
+    check( regex("^(foo|bar)$", "bar"),         "'^(foo|bar)$' ~ 'bar'");
+    check(!regex("^(foo|bar)$", "baz"),         "'^(foo|bar)$' !~ 'baz'");
+    check( regex("^foo|bar$", "xxbar"),         "'^foo|bar$' ~ 'xxbar'");
+    check( regex("^(?:ab)+$", "ababab"),        "'^(?:ab)+$' ~ 'ababab'");
+    check(!regex("^(?:ab)+$", "ababa"),         "'^(?:ab)+$' !~ 'ababa'");
+    check( regex("^a(b|)c$", "ac"),             "'^a(b|)c$' ~ 'ac'");
+
+    // Повторения
+    check( regex("^ab*c$", "ac"),               "'^ab*c$' ~ 'ac'");
+    check(!regex("^ab+c$", "ac"),               "'^ab+c$' !~ 'ac'");
+    check( regex("^ab?c$", "abc"),              "'^ab?c$' ~ 'abc'");
+    check(!regex("^ab?c$", "abbc"),             "'^ab?c$' !~ 'abbc'");
+    check( regex("^a{3}$", "aaa"),              "'^a{3}$' ~ 'aaa'");
+    check(!regex("^a{3}$", "aaaa"),             "'^a{3}$' !~ 'aaaa'");
+    check( regex("^a{2,}$", "aaaaa"),           "'^a{2,}$' ~ 'aaaaa'");
+    check(!regex("^a{2,}$", "a"),               "'^a{2,}$' !~ 'a'");
+    check( regex("^a{2,3}$", "aaa"),            "'^a{2,3}$' ~ 'aaa'");
+    check(!regex("^a{2,3}$", "aaaa"),           "'^a{2,3}$' !~ 'aaaa'");
+
+    // Патологический для поиска с возвратами шаблон
+    string text(5000, 'a');
+    check(!regex("^(a|a)*b$", text),            "'^(a|a)*b$' !~ 'a...a' (linear time)");
+
+    // Синтаксические ошибки
+    check( invalid("(abc", Syntax::Regex),      "'(abc' is invalid regex");
+    check( invalid("abc)", Syntax::Regex),      "'abc)' is invalid regex");
+    check( invalid("[abc", Syntax::Regex),      "'[abc' is invalid regex");
+    check( invalid("*abc", Syntax::Regex),      "'*abc' is invalid regex");
+    check( invalid("a{3,2}", Syntax::Regex),    "'a{3,2}' is invalid regex");
+    check( invalid("abc\\", Syntax::Regex),     "'abc\\' is invalid regex");
+}
+
+bool loadFilter(const string& yaml)
+{
+    Filter::List filters;
+    return loadFilters(YAML::Load(yaml), filters, "pattern_matcher_utest");
+}
+
+void config_Test()
+{
+    printf("\n=== Config Test ===\n");
+
+    check( loadFilter("- name: f1\n"
+                      "  type: pattern\n"
+                      "  target: file\n"
+                      "  syntax: regex\n"
+                      "  patterns: ['^logger\\.(h|cpp)$']\n"),
+          "valid regex pattern filter");
+
+    check(!loadFilter("- name: f2\n"
+                      "  type: pattern\n"
+                      "  syntax: regex\n"
+                      "  patterns: ['(abc']\n"),
+          "invalid regex pattern is rejected");
+
+    check(!loadFilter("- name: f3\n"
+                      "  type: pattern\n"
+                      "  patterns: ['[abc']\n"),
+          "invalid glob pattern is rejected");
+
+    check(!loadFilter("- name: f4\n"
+                      "  type: pattern\n"
+                      "  syntax: pcre\n"
+                      "  patterns: ['abc']\n"),
+          "unknown syntax is rejected");
+
+    check(!loadFilter("- name: f5\n"
+                      "  type: pattern\n"
+                      "  target: thread\n"
+                      "  patterns: ['abc']\n"),
+          "unknown target is rejected");
+
+    check(!loadFilter("- name: f6\n"
+                      "  type: pattern\n"
+                      "  patterns: abc\n"),
+          "scalar 'patterns' is rejected");
+}
+
+int main()
+{
+    glob_Test();
+    regex_Test();
+    config_Test();
+
+    alog::stop();
+
+    if (failCount)
+    {
+        printf("\nFailed: %d\n", failCount);
+        exit(1);
+    }
+    printf("\nAll tests passed\n");
+    return 0;
+}
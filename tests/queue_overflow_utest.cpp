@@ -0,0 +1,121 @@
+/* clang-format off */
+
+// Команда для сборки
+// g++ -std=c++17 -ggdb3 -I.. queue_overflow_utest.cpp ../logger/logger.cpp
+//     ../logger/matchers.cpp ../logger/utf8.cpp ../thread/thread_base.cpp
+//     ../thread/thread_utils.cpp ../thread/thread_pool.cpp -lpthread
+//     -o queue_overflow_utest
+
+#include "logger/logger.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace alog;
+
+int failCount = 0;
+
+void check(bool b, const char* descr)
+{
+    printf("%-60s : %s\n", descr, (b) ? "OK" : "FAIL");
+    if (!b)
+        ++failCount;
+}
+
+// Сейвер, сохраняющий тексты полученных сообщений
+class CollectSaver : public Saver
+{
+public:
+    CollectSaver(const string& name, bool immediately)
+        : Saver(name, Level::Debug2), _immediately(immediately)
+    {}
+
+    bool flushImmediately() const override {return _immediately;}
+
+    vector<string> lines()
+    {
+        lock_guard<mutex> locker {_lock}; (void) locker;
+        return _lines;
+    }
+
+protected:
+    void flushImpl(const MessageList& messages) override
+    {
+        lock_guard<mutex> locker {_lock}; (void) locker;
+        for (Message* m : messages)
+            if (m->level <= level() && m->str.compare(0, 5, "line ") == 0)
+                _lines.push_back(m->str);
+    }
+
+private:
+    const bool _immediately;
+    mutex _lock;
+    vector<string> _lines;
+};
+
+void dropOldest_Test()
+{
+    printf("\n=== DropOldest Test ===\n");
+
+    const int threads = 4;
+    const int count = 20000;
+
+    CollectSaver* immediate = new CollectSaver("immediate", true);
+    CollectSaver* buffered  = new CollectSaver("buffered", false);
+    logger().addSaver(Saver::Ptr(immediate));
+    logger().addSaver(Saver::Ptr(buffered));
+
+    // Сообщения накапливаются для отложенной записи, пока в очередь  посту-
+    // пают новые сообщения
+    logger().setFlushTime(5000);
+    logger().setFlushSize(1000000);
+    logger().setQueueMaxCount(100);
+    logger().setOverflowPolicy(Logger::OverflowPolicy::DropOldest);
+    logger().setOverflowReportTime(0);
+    logger().start();
+
+    vector<thread> producers;
+    for (int t = 0; t < threads; ++t)
+        producers.emplace_back([t]()
+        {
+            for (int i = 0; i < count; ++i)
+                log_debug << "line " << t << "-" << i;
+        });
+    for (thread& producer : producers)
+        producer.join();
+
+    logger().flush();
+    logger().waitingFlush();
+
+    vector<string> immediateLines = immediate->lines();
+    vector<string> bufferedLines = buffered->lines();
+    uint64_t dropped = logger().droppedMessages(Level::Debug);
+
+    printf("  produced: %d, saved: %zu, dropped: %llu\n", threads * count,
+           bufferedLines.size(), (unsigned long long)dropped);
+
+    check(dropped > 0,                          "messages are dropped");
+    check(immediateLines == bufferedLines,      "immediate and buffered savers agree");
+    check(bufferedLines.size() + dropped == uint64_t(threads * count),
+                                                "saved + dropped == produced");
+
+    alog::stop();
+}
+
+int main()
+{
+    dropOldest_Test();
+
+    if (failCount)
+    {
+        printf("\nFailed: %d\n", failCount);
+        exit(1);
+    }
+    printf("\nAll tests passed\n");
+    return 0;
+}
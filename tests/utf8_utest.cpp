@@ -0,0 +1,387 @@
+/* clang-format off */
+
+// Команда для сборки
+// g++ -std=c++17 -ggdb3 -I.. utf8_utest.cpp ../logger/utf8.cpp -o utf8_utest
+
+#include "logger/utf8.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace alog::detail;
+
+int failCount = 0;
+
+void check(bool b, const char* descr)
+{
+    printf("%-60s : %s\n", descr, (b) ? "OK" : "FAIL");
+    if (!b)
+        ++failCount;
+}
+
+// Эталонная реализация. Проверка выполняется через декодирование кодовых то-
+// чек, независимо от табличной проверки первого байта в logger/utf8.cpp
+
+// Возвращает длину последовательности по первому байту и минимальную кодовую
+// точку для этой длины (0 - байт не может начинать последовательность)
+size_t refLeadLength(unsigned char c, uint32_t& cp, uint32_t& minCp)
+{
+    if (c < 0x80) {cp = c;        minCp = 0;       return 1;}
+    if (c < 0xC0) {                                return 0;}
+    if (c < 0xE0) {cp = c & 0x1F; minCp = 0x80;    return 2;}
+    if (c < 0xF0) {cp = c & 0x0F; minCp = 0x800;   return 3;}
+    if (c < 0xF8) {cp = c & 0x07; minCp = 0x10000; return 4;}
+    return 0;
+}
+
+bool refCodePoint(uint32_t cp, uint32_t minCp)
+{
+    return (cp >= minCp) && (cp <= 0x10FFFF) && !(cp >= 0xD800 && cp <= 0xDFFF);
+}
+
+// Длина корректной последовательности в начале текста, 0 - некорректна
+size_t refSequence(const unsigned char* p, size_t size)
+{
+    uint32_t cp, minCp;
+    size_t len = refLeadLength(p[0], cp, minCp);
+    if (len == 0 || len > size)
+        return 0;
+    for (size_t i = 1; i < len; ++i)
+    {
+        if ((p[i] & 0xC0) != 0x80)
+            return 0;
+        cp = (cp << 6) | (p[i] & 0x3F);
+    }
+    return refCodePoint(cp, minCp) ? len : 0;
+}
+
+// Проверяет, что первые count байт можно дополнить до корректной последова-
+// тельности. Дополнения образуют непрерывный интервал кодовых точек, который
+// сравнивается с интервалами допустимых значений
+bool refPrefix(const unsigned char* p, size_t count)
+{
+    uint32_t cp, minCp;
+    size_t len = refLeadLength(p[0], cp, minCp);
+    if (len == 0 || count >= len)
+        return false;
+
+    uint32_t lo = cp, hi = cp;
+    for (size_t i = 1; i < len; ++i)
+    {
+        unsigned char b = 0x80;
+        if (i < count)
+        {
+            if ((p[i] & 0xC0) != 0x80)
+                return false;
+            b = p[i];
+        }
+        lo = (lo << 6) | (b & 0x3F);
+        hi = (hi << 6) | ((i < count) ? (b & 0x3F) : 0x3F);
+    }
+    auto overlap = [lo, hi](uint32_t a, uint32_t b) {return max(lo, a) <= min(hi, b);};
+    return overlap(minCp, 0xD7FF) || overlap(max(minCp, 0xE000u), 0x10FFFF);
+}
+
+bool refValid(const string& text)
+{
+    const unsigned char* p = (const unsigned char*)text.c_str();
+    for (size_t i = 0; i < text.size();)
+    {
+        size_t len = refSequence(p + i, text.size() - i);
+        if (len == 0)
+            return false;
+        i += len;
+    }
+    return true;
+}
+
+// Замена некорректных последовательностей по правилу максимальной части
+// (Unicode, раздел 3.9 "U+FFFD Substitution of Maximal Subparts")
+size_t refSanitize(const string& text, string& out)
+{
+    const unsigned char* p = (const unsigned char*)text.c_str();
+    size_t replaced = 0;
+    for (size_t i = 0; i < text.size();)
+    {
+        size_t len = refSequence(p + i, text.size() - i);
+        if (len)
+        {
+            out.append(text, i, len);
+            i += len;
+            continue;
+        }
+        size_t invalid = 1;
+        while (i + invalid < text.size() && refPrefix(p + i, invalid + 1))
+            ++invalid;
+
+        out += "\xEF\xBF\xBD";
+        ++replaced;
+        i += invalid;
+    }
+    return replaced;
+}
+
+// Результаты всех реализаций проверки, доступных на процессоре
+struct Kernel
+{
+    const char* name;
+    bool (*func)(const unsigned char*, size_t);
+};
+
+vector<Kernel> kernels()
+{
+    vector<Kernel> res {{"scalar", utf8ValidScalar}};
+#ifdef ALOG_UTF8_SIMD
+    if (utf8SimdSupported(Utf8Simd::Ssse3))
+        res.push_back({"ssse3", utf8ValidSsse3});
+    if (utf8SimdSupported(Utf8Simd::Avx2))
+        res.push_back({"avx2", utf8ValidAvx2});
+#endif
+    return res;
+}
+
+const vector<Kernel> validKernels = kernels();
+
+int mismatches = 0;
+
+// Сравнивает результат всех реализаций (и utf8Valid()) с эталоном
+void crossCheck(const string& text)
+{
+    bool expected = refValid(text);
+    auto report = [&](const char* name, bool res)
+    {
+        if (res == expected)
+            return;
+        if (mismatches++ < 10)
+        {
+            printf("  mismatch (%s, expected %d), size %zu:", name, int(expected),
+                   text.size());
+            for (unsigned char c : text)
+                printf(" %02X", c);
+            printf("\n");
+        }
+    };
+    const unsigned char* p = (const unsigned char*)text.c_str();
+    for (const Kernel& kernel : validKernels)
+        report(kernel.name, kernel.func(p, text.size()));
+    report("utf8Valid", utf8Valid(text));
+}
+
+// Вставляет последовательность seq в ASCII текст размером size в позиции pos
+string embed(const string& seq, size_t size, size_t pos)
+{
+    string text(size, 'a');
+    text.replace(pos, seq.size(), seq);
+    return text;
+}
+
+void kernels_Test()
+{
+    printf("\n=== Kernels Test ===\n");
+
+    printf("  kernels:");
+    for (const Kernel& kernel : validKernels)
+        printf(" %s", kernel.name);
+    printf("\n");
+
+    mismatches = 0;
+    const vector<string> samples {
+        // Корректные последовательности на границах диапазонов
+        "\x7F", "\xC2\x80", "\xDF\xBF", "\xE0\xA0\x80", "\xED\x9F\xBF",
+        "\xEE\x80\x80", "\xEF\xBF\xBF", "\xF0\x90\x80\x80", "\xF4\x8F\xBF\xBF",
+        // Избыточное кодирование
+        "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xE0\x9F\xBF", "\xF0\x80\x80\x80",
+        "\xF0\x8F\xBF\xBF",
+        // Суррогаты
+        "\xED\xA0\x80", "\xED\xAF\xBF", "\xED\xB0\x80", "\xED\xBF\xBF",
+        // Больше U+10FFFF и запрещенные байты
+        "\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xF8\x88\x80\x80\x80", "\xFE", "\xFF",
+        // Незавершенные последовательности и лишние байты продолжения
+        "\xC2", "\xE0\xA0", "\xF0\x90\x80", "\x80", "\xBF", "\xC2\x80\x80",
+        "\xE2\x82\xAC\x80"
+    };
+
+    // Последовательности в каждой позиции текста, пересекающей границы 16- и
+    // 32-байтовых блоков, в том числе в конце текста (незавершенные)
+    for (const string& seq : samples)
+        for (size_t size : {16, 17, 31, 32, 33, 63, 64, 65, 100})
+            for (size_t pos = 0; pos + seq.size() <= size; ++pos)
+                crossCheck(embed(seq, size, pos));
+    check(mismatches == 0, "boundary/overlong/surrogate samples");
+
+    // Все пары байт, пересекающие границы блоков
+    mismatches = 0;
+    for (int b1 = 0x80; b1 < 0x100; ++b1)
+        for (int b2 = 0; b2 < 0x100; ++b2)
+        {
+            string seq {char(b1), char(b2)};
+            for (size_t pos : {14, 15, 16, 30, 31, 32, 62})
+                crossCheck(embed(seq, 64, pos));
+        }
+    check(mismatches == 0, "all byte pairs at block boundaries");
+
+    // Все трехбайтовые последовательности с первым байтом E0..F4 на границе
+    // 32-байтового блока (проверка байтов продолжения через границу)
+    mismatches = 0;
+    for (int b1 = 0xE0; b1 <= 0xF4; ++b1)
+        for (int b2 = 0x70; b2 < 0xD0; ++b2)
+            for (int b3 = 0x70; b3 < 0xD0; ++b3)
+            {
+                string seq {char(b1), char(b2), char(b3), char(0x80)};
+                crossCheck(embed(seq, 40, 30));
+                crossCheck(embed(seq, 40, 29));
+            }
+    check(mismatches == 0, "3/4-byte sequences across 32-byte boundary");
+}
+
+// Случайный текст из корректных символов, ASCII и случайных байт
+string randomText(std::mt19937& rnd, size_t maxLen, bool valid)
+{
+    static const vector<string> chars {
+        "a", "Z", " ", "\xD0\x96", "\xC2\xA9", "\xE2\x82\xAC", "\xED\x9F\xBF",
+        "\xEF\xBF\xBD", "\xF0\x9F\x98\x80", "\xF4\x8F\xBF\xBF"
+    };
+    string text;
+    size_t len = rnd() % (maxLen + 1);
+    while (text.size() < len)
+    {
+        if (!valid && (rnd() % 8 == 0))
+            text += char(rnd() % 256);
+        else
+            text += chars[rnd() % chars.size()];
+    }
+    return text;
+}
+
+void random_Test()
+{
+    printf("\n=== Random Test (cross-check with reference decoder) ===\n");
+
+    std::mt19937 rnd {12345};
+    mismatches = 0;
+    int invalid = 0;
+    for (int i = 0; i < 100000; ++i)
+    {
+        string text = randomText(rnd, 150, (i % 4 == 0));
+        invalid += int(!refValid(text));
+        crossCheck(text);
+    }
+    printf("  invalid texts: %d of 100000\n", invalid);
+    check(mismatches == 0, "random texts cross-check");
+}
+
+void sanitize_Test()
+{
+    printf("\n=== Sanitize Test ===\n");
+
+    auto sanitize = [](const string& text, size_t* replaced = nullptr)
+    {
+        string out;
+        size_t n = utf8Sanitize(text.c_str(), text.size(), out);
+        if (replaced) *replaced = n;
+        return out;
+    };
+    const string R = "\xEF\xBF\xBD";
+
+    check(sanitize("abc \xD0\x96") == "abc \xD0\x96",     "valid text is unchanged");
+    check(sanitize("") == "",                             "empty text");
+    check(sanitize("a\xFF" "b") == "a" + R + "b",         "single bad byte");
+    check(sanitize("\xC0\x80") == R + R,                  "overlong C0 80 -> 2 x U+FFFD");
+    check(sanitize("\xE0\x80\x80") == R + R + R,          "overlong E0 80 80 -> 3 x U+FFFD");
+    check(sanitize("\xED\xA0\x80") == R + R + R,          "surrogate ED A0 80 -> 3 x U+FFFD");
+    check(sanitize("\xF4\x90\x80\x80") == R + R + R + R,  "F4 90 80 80 -> 4 x U+FFFD");
+    check(sanitize("\xE2\x82" "a") == R + "a",            "truncated E2 82 -> 1 x U+FFFD");
+    check(sanitize("\xF0\x9F\x98") == R,                  "truncated F0 9F 98 at end");
+
+    string out = "prefix:";
+    utf8Sanitize("\xFF", 1, out);
+    check(out == "prefix:" + R,                           "output is appended");
+
+    // Сравнение с эталоном: результат, количество замен, корректность
+    std::mt19937 rnd {54321};
+    int mismatch = 0;
+    for (int i = 0; i < 50000; ++i)
+    {
+        string text = randomText(rnd, 100, false);
+        string expected;
+        size_t expectedReplaced = refSanitize(text, expected);
+        size_t replaced;
+        string res = sanitize(text, &replaced);
+        if (res != expected || replaced != expectedReplaced || !refValid(res))
+            if (mismatch++ < 10)
+                printf("  mismatch: size %zu, replaced %zu (expected %zu)\n",
+                       text.size(), replaced, expectedReplaced);
+    }
+    check(mismatch == 0, "random texts cross-check");
+}
+
+void crop_Test()
+{
+    printf("\n=== Crop Test ===\n");
+
+    auto crop = [](const string& text, size_t maxSize, bool& error)
+    {
+        return utf8CropSize(text.c_str(), text.size(), maxSize, error);
+    };
+    bool error;
+
+    const string text = "ab\xD0\x96\xE2\x82\xAC\xF0\x9F\x98\x80" "c"; // 12 байт
+    check(crop(text, 100, error) == text.size() && !error, "maxSize >= size");
+    check(crop(text, 2, error) == 2 && !error,             "crop at ASCII border");
+    check(crop(text, 3, error) == 2 && !error,             "crop inside 2-byte char");
+    check(crop(text, 6, error) == 4 && !error,             "crop inside 3-byte char");
+    check(crop(text, 10, error) == 7 && !error,            "crop inside 4-byte char");
+    check(crop(text, 11, error) == 11 && !error,           "crop after 4-byte char");
+
+    // Граница символа не найдена
+    check(crop("\xE2\x82\xAC", 2, error) == 2 && error,    "crop inside first char");
+    check(crop("a\x80\x80\x80\x80", 4, error) == 4 && error, "too many continuation bytes");
+
+    // Сравнение с эталоном: для корректного текста результат - ближайшая
+    // слева граница символа (кроме нулевой позиции)
+    std::mt19937 rnd {777};
+    int mismatch = 0;
+    for (int i = 0; i < 20000; ++i)
+    {
+        string text = randomText(rnd, 60, true);
+        for (size_t maxSize = 0; maxSize <= text.size(); ++maxSize)
+        {
+            size_t expected = maxSize;
+            while (expected > 0 && expected < text.size()
+                   && (text[expected] & 0xC0) == 0x80)
+                --expected;
+            bool expectedError = (expected == 0) && (maxSize < text.size());
+            if (expectedError)
+                expected = maxSize;
+
+            size_t res = crop(text, maxSize, error);
+            bool ok = (res == expected) && (error == expectedError);
+            if (ok && !error)
+                ok = refValid(text.substr(0, res));
+            if (!ok && mismatch++ < 10)
+                printf("  mismatch: size %zu, maxSize %zu, res %zu (expected %zu)\n",
+                       text.size(), maxSize, res, expected);
+        }
+    }
+    check(mismatch == 0, "random texts cross-check");
+}
+
+int main()
+{
+    kernels_Test();
+    random_Test();
+    sanitize_Test();
+    crop_Test();
+
+    if (failCount)
+    {
+        printf("\nFailed: %d\n", failCount);
+        exit(1);
+    }
+    printf("\nAll tests passed\n");
+    return 0;
+}
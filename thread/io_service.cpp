@@ -0,0 +1,710 @@
+/* clang-format off */
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2026 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*****************************************************************************/
+
+#include "io_service.h"
+#include "break_point.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+namespace trd {
+
+struct IoService::Op
+{
+    enum class Type {Write, Fsync, Release};
+
+    Type type = {Type::Write};
+    bool flag = {false}; // Fsync: только данные; Release: закрыть дескриптор
+    vector<string> buffers;
+    Callback callback;
+
+    int64_t size() const
+    {
+        int64_t res = 0;
+        for (const string& buff : buffers)
+            res += int64_t(buff.size());
+        return res;
+    }
+};
+
+struct IoService::File
+{
+    int fd = {-1};
+    int64_t offset = {0}; // Смещение для следующей операции записи
+    bool busy = {false};  // Для файла выполняется пакет операций
+    bool released = {false};
+    deque<Op> queue;
+};
+
+// Пакет операций, отправляемый на выполнение одним системным вызовом
+struct IoService::Batch
+{
+    int fileId = {-1};
+    File* file = {nullptr};
+    Op::Type type = {Op::Type::Write};
+    vector<Op> ops;
+
+    vector<iovec> iov;
+    size_t  iovPos = {0};  // Первый незаписанный элемент iov
+    int64_t offset = {0};  // Смещение в файле на момент формирования пакета
+    int64_t size = {0};    // Общий размер данных пакета
+    int64_t written = {0};
+
+    int iovCount() const
+    {
+        return int(std::min<size_t>(iov.size() - iovPos, IOV_MAX));
+    }
+};
+
+#if defined(__linux__)
+struct IoService::Ring
+{
+    int fd = {-1};
+    unsigned entries = {0};
+
+    unsigned* sqHead = {nullptr};
+    unsigned* sqTail = {nullptr};
+    unsigned* sqArray = {nullptr};
+    unsigned  sqMask = {0};
+    io_uring_sqe* sqes = {nullptr};
+
+    unsigned* cqHead = {nullptr};
+    unsigned* cqTail = {nullptr};
+    unsigned  cqMask = {0};
+    io_uring_cqe* cqes = {nullptr};
+
+    void*  sqPtr = {nullptr};
+    size_t sqSize = {0};
+    void*  cqPtr = {nullptr};
+    size_t cqSize = {0};
+    size_t sqesSize = {0};
+
+    unsigned toSubmit = {0}; // Количество заполненных, но не отправленных sqe
+    atomic_bool wakeupPending = {false};
+};
+#else
+struct IoService::Ring {};
+#endif
+
+IoService::~IoService()
+{
+    stop();
+    for (File* file : _files)
+        delete file;
+}
+
+bool IoService::start(bool useIoUring)
+{
+    lock_guard<mutex> locker {_startLock}; (void) locker;
+
+    if (_backend != Backend::None)
+        return true;
+
+    _stop = false;
+    Backend backend = Backend::Thread;
+#if defined(__linux__)
+    if (useIoUring && ringInit())
+        backend = Backend::IoUring;
+#else
+    (void) useIoUring;
+#endif
+    _backend = backend;
+    _thread = thread([this]() {run();});
+    return true;
+}
+
+void IoService::stop()
+{
+    lock_guard<mutex> locker {_startLock}; (void) locker;
+
+    if (_backend == Backend::None)
+        return;
+
+    { //Block for unique_lock
+        unique_lock<mutex> locker2 {_lock}; (void) locker2;
+        _stop = true;
+    }
+    wakeup();
+
+    if (_thread.joinable())
+        _thread.join();
+
+#if defined(__linux__)
+    ringFree();
+#endif
+    _backend = Backend::None;
+}
+
+int IoService::registerFile(int fd)
+{
+    if (_backend == Backend::None || _stop)
+        return -1;
+
+    off_t offset = ::lseek(fd, 0, SEEK_END);
+
+    File* file = new File;
+    file->fd = fd;
+    file->offset = (offset > 0) ? int64_t(offset) : 0;
+
+    unique_lock<mutex> locker {_lock}; (void) locker;
+    if (_freeIds.empty())
+    {
+        _files.push_back(file);
+        return int(_files.size() - 1);
+    }
+    int id = _freeIds.back();
+    _freeIds.pop_back();
+    _files[id] = file;
+    return id;
+}
+
+void IoService::releaseFile(int fileId, bool closeFd, Callback callback)
+{
+    Op op;
+    op.type = Op::Type::Release;
+    op.flag = closeFd;
+    op.callback = std::move(callback);
+
+    // Освобождение выполняется и для остановленного сервиса
+    if (!enqueue(fileId, std::move(op)))
+    {
+        unique_lock<mutex> locker {_lock}; (void) locker;
+        if (fileId < 0 || fileId >= int(_files.size()) || !_files[fileId])
+            return;
+
+        File* file = _files[fileId];
+        if (file->busy || !file->queue.empty())
+            return;
+
+        if (closeFd)
+            ::close(file->fd);
+        delete file;
+        _files[fileId] = nullptr;
+        _freeIds.push_back(fileId);
+    }
+}
+
+bool IoService::append(int fileId, vector<string>&& buffers, Callback callback)
+{
+    Op op;
+    op.type = Op::Type::Write;
+    op.buffers = std::move(buffers);
+    op.callback = std::move(callback);
+    return enqueue(fileId, std::move(op));
+}
+
+bool IoService::append(int fileId, string&& buffer, Callback callback)
+{
+    vector<string> buffers;
+    buffers.push_back(std::move(buffer));
+    return append(fileId, std::move(buffers), std::move(callback));
+}
+
+bool IoService::fsync(int fileId, bool dataOnly, Callback callback)
+{
+    Op op;
+    op.type = Op::Type::Fsync;
+    op.flag = dataOnly;
+    op.callback = std::move(callback);
+    return enqueue(fileId, std::move(op));
+}
+
+void IoService::wait()
+{
+    unique_lock<mutex> locker {_lock};
+    _idleCond.wait(locker, [this]() {return _pending == 0;});
+}
+
+bool IoService::enqueue(int fileId, Op&& op)
+{
+    { //Block for unique_lock
+        unique_lock<mutex> locker {_lock}; (void) locker;
+        if (_stop || _backend == Backend::None)
+            return false;
+
+        if (fileId < 0 || fileId >= int(_files.size()) || !_files[fileId])
+            return false;
+
+        File* file = _files[fileId];
+        if (file->released)
+            return false;
+
+        file->released = (op.type == Op::Type::Release);
+        file->queue.push_back(std::move(op));
+        ++_pending;
+    }
+    wakeup();
+    return true;
+}
+
+void IoService::wakeup()
+{
+#if defined(__linux__)
+    if (_backend == Backend::IoUring)
+    {
+        // Повторная запись в eventfd не нужна, пока поток сервиса не обработал
+        // предыдущее пробуждение
+        if (!_ring->wakeupPending.exchange(true))
+        {
+            uint64_t val = 1;
+            while (::write(_eventFd, &val, sizeof(val)) < 0 && errno == EINTR) {}
+        }
+        return;
+    }
+#endif
+    _cond.notify_one();
+}
+
+void IoService::dispatch(vector<Batch*>& batches)
+{
+    // Количество пакетов, одновременно находящихся в io_uring, ограничено,
+    // чтобы не переполнить очередь завершений
+    int limit = INT_MAX;
+#if defined(__linux__)
+    if (_backend == Backend::IoUring)
+        limit = int(_ring->entries) - 1 - _inflight;
+#endif
+
+    for (size_t i = 0; i < _files.size(); ++i)
+    {
+        if (int(batches.size()) >= limit)
+            break;
+
+        File* file = _files[i];
+        if (file == nullptr || file->busy || file->queue.empty())
+            continue;
+
+        Batch* batch = new Batch;
+        batch->fileId = int(i);
+        batch->file = file;
+        batch->type = file->queue.front().type;
+        batch->offset = file->offset;
+
+        if (batch->type == Op::Type::Write)
+        {
+            // Объединяем все подряд идущие операции записи
+            while (!file->queue.empty() && file->queue.front().type == Op::Type::Write)
+            {
+                batch->ops.push_back(std::move(file->queue.front()));
+                file->queue.pop_front();
+            }
+            for (const Op& op : batch->ops)
+                for (const string& buff : op.buffers)
+                {
+                    if (buff.empty())
+                        continue;
+                    batch->iov.push_back(iovec{(void*)buff.data(), buff.size()});
+                    batch->size += int64_t(buff.size());
+                }
+        }
+        else
+        {
+            batch->ops.push_back(std::move(file->queue.front()));
+            file->queue.pop_front();
+        }
+        file->busy = true;
+        batches.push_back(batch);
+    }
+}
+
+bool IoService::complete(Batch* batch, int64_t result)
+{
+    if (batch->type == Op::Type::Write)
+    {
+        if (result == -EINTR || result == -EAGAIN)
+            return false;
+
+        if (result > 0)
+        {
+            batch->written += result;
+            size_t written = size_t(result);
+            while (batch->iovPos < batch->iov.size()
+                   && written >= batch->iov[batch->iovPos].iov_len)
+            {
+                written -= batch->iov[batch->iovPos].iov_len;
+                ++batch->iovPos;
+            }
+            if (written)
+            {
+                iovec& iov = batch->iov[batch->iovPos];
+                iov.iov_base = (char*)iov.iov_base + written;
+                iov.iov_len -= written;
+            }
+            if (batch->written < batch->size)
+                return false;
+        }
+        else if (result == 0 && batch->written < batch->size)
+        {
+            result = -EIO;
+        }
+    }
+    else if (batch->type == Op::Type::Release)
+    {
+        if (batch->ops[0].flag)
+            ::close(batch->file->fd);
+        result = 0;
+    }
+
+    for (Op& op : batch->ops)
+        if (op.callback)
+        {
+            int64_t res = result;
+            if (res >= 0)
+                res = (batch->type == Op::Type::Write) ? op.size() : 0;
+            op.callback(res);
+        }
+
+    { //Block for unique_lock
+        unique_lock<mutex> locker {_lock}; (void) locker;
+        if (batch->type == Op::Type::Release)
+        {
+            delete batch->file;
+            _files[batch->fileId] = nullptr;
+            _freeIds.push_back(batch->fileId);
+        }
+        else
+        {
+            batch->file->offset = batch->offset + batch->written;
+            batch->file->busy = false;
+        }
+        _pending -= batch->ops.size();
+        if (_pending == 0)
+            _idleCond.notify_all();
+    }
+    delete batch;
+    return true;
+}
+
+void IoService::executeThread(Batch* batch)
+{
+    while (true)
+    {
+        int64_t res = 0;
+        if (batch->type == Op::Type::Write && batch->size)
+        {
+            ssize_t r = ::pwritev(batch->file->fd, batch->iov.data() + batch->iovPos,
+                                  batch->iovCount(), off_t(batch->offset + batch->written));
+            res = (r < 0) ? -int64_t(errno) : int64_t(r);
+        }
+        else if (batch->type == Op::Type::Fsync)
+        {
+#if defined(__linux__)
+            int r = (batch->ops[0].flag) ? ::fdatasync(batch->file->fd)
+                                         : ::fsync(batch->file->fd);
+#else
+            int r = ::fsync(batch->file->fd);
+#endif
+            res = (r < 0) ? -int64_t(errno) : 0;
+        }
+        if (complete(batch, res))
+            break;
+    }
+}
+
+void IoService::run()
+{
+    vector<Batch*> batches;
+    while (true)
+    {
+        { //Block for unique_lock
+            unique_lock<mutex> locker {_lock};
+            dispatch(batches);
+
+            if (batches.empty() && _stop && _pending == 0)
+                break;
+
+            if (batches.empty() && _backend == Backend::Thread)
+            {
+                _cond.wait(locker);
+                continue;
+            }
+        }
+
+        // Освобождение файла не требует системного вызова для io_uring
+        // и выполняется сразу
+        for (Batch*& batch : batches)
+            if (batch->type == Op::Type::Release
+                || (batch->type == Op::Type::Write && batch->size == 0))
+            {
+                complete(batch, 0);
+                batch = nullptr;
+            }
+
+#if defined(__linux__)
+        if (_backend == Backend::IoUring)
+        {
+            for (Batch* batch : batches)
+                if (batch && ringSubmit(batch))
+                    ++_inflight;
+
+            ringEnter(_ring->toSubmit, 1);
+            ringReap();
+            batches.clear();
+            continue;
+        }
+#endif
+        for (Batch* batch : batches)
+            if (batch)
+                executeThread(batch);
+        batches.clear();
+    }
+}
+
+#if defined(__linux__)
+bool IoService::ringInit()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int fd = int(::syscall(__NR_io_uring_setup, 256, &params));
+    if (fd < 0)
+        return false;
+
+    _ring = new Ring;
+    Ring& r = *_ring;
+    r.fd = fd;
+    r.entries = params.sq_entries;
+
+    r.sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    r.cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        r.sqSize = r.cqSize = std::max(r.sqSize, r.cqSize);
+
+    r.sqPtr = ::mmap(0, r.sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     fd, IORING_OFF_SQ_RING);
+    if (r.sqPtr == MAP_FAILED)
+    {
+        r.sqPtr = nullptr;
+        ringFree();
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        r.cqPtr = r.sqPtr;
+    }
+    else
+    {
+        r.cqPtr = ::mmap(0, r.cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         fd, IORING_OFF_CQ_RING);
+        if (r.cqPtr == MAP_FAILED)
+        {
+            r.cqPtr = nullptr;
+            ringFree();
+            return false;
+        }
+    }
+    r.sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(0, r.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        ringFree();
+        return false;
+    }
+    r.sqes = (io_uring_sqe*)sqes;
+
+    char* sq = (char*)r.sqPtr;
+    r.sqHead  = (unsigned*)(sq + params.sq_off.head);
+    r.sqTail  = (unsigned*)(sq + params.sq_off.tail);
+    r.sqMask  = *(unsigned*)(sq + params.sq_off.ring_mask);
+    r.sqArray = (unsigned*)(sq + params.sq_off.array);
+
+    char* cq = (char*)r.cqPtr;
+    r.cqHead = (unsigned*)(cq + params.cq_off.head);
+    r.cqTail = (unsigned*)(cq + params.cq_off.tail);
+    r.cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    r.cqes   = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    // Пробуждение потока сервиса выполняется через eventfd, ожидание
+    // которого поставлено в io_uring
+    _eventFd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_eventFd < 0)
+    {
+        ringFree();
+        return false;
+    }
+    ringPollWakeup();
+    if (ringEnter(r.toSubmit, 0) < 0)
+    {
+        ringFree();
+        return false;
+    }
+    return true;
+}
+
+void IoService::ringFree()
+{
+    if (_ring == nullptr)
+        return;
+
+    Ring& r = *_ring;
+    if (r.sqes)
+        ::munmap(r.sqes, r.sqesSize);
+    if (r.cqPtr && r.cqPtr != r.sqPtr)
+        ::munmap(r.cqPtr, r.cqSize);
+    if (r.sqPtr)
+        ::munmap(r.sqPtr, r.sqSize);
+    if (r.fd >= 0)
+        ::close(r.fd);
+
+    if (_eventFd >= 0)
+        ::close(_eventFd);
+
+    _eventFd = -1;
+    _inflight = 0;
+
+    delete _ring;
+    _ring = nullptr;
+}
+
+bool IoService::ringSubmit(Batch* batch)
+{
+    Ring& r = *_ring;
+
+    // Очередь отправки заполнена: передаем накопленные sqe ядру
+    unsigned tail = *r.sqTail;
+    if (tail - __atomic_load_n(r.sqHead, __ATOMIC_ACQUIRE) >= r.entries)
+    {
+        ringEnter(r.toSubmit, 0);
+        tail = *r.sqTail;
+    }
+
+    unsigned index = tail & r.sqMask;
+    io_uring_sqe* sqe = &r.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+
+    if (batch)
+    {
+        sqe->fd = batch->file->fd;
+        sqe->user_data = uint64_t(uintptr_t(batch));
+        if (batch->type == Op::Type::Write)
+        {
+            sqe->opcode = IORING_OP_WRITEV;
+            sqe->addr = uint64_t(uintptr_t(batch->iov.data() + batch->iovPos));
+            sqe->len = unsigned(batch->iovCount());
+            sqe->off = uint64_t(batch->offset + batch->written);
+        }
+        else
+        {
+            sqe->opcode = IORING_OP_FSYNC;
+            if (batch->ops[0].flag)
+                sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        }
+    }
+    else
+    {
+        // Ожидание события eventfd, user_data = 0
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = _eventFd;
+        sqe->poll_events = POLLIN;
+    }
+
+    r.sqArray[index] = index;
+    __atomic_store_n(r.sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++r.toSubmit;
+    return true;
+}
+
+void IoService::ringPollWakeup()
+{
+    ringSubmit(nullptr);
+}
+
+int IoService::ringEnter(unsigned toSubmit, unsigned minComplete)
+{
+    unsigned flags = (minComplete) ? IORING_ENTER_GETEVENTS : 0;
+    while (true)
+    {
+        int res = int(::syscall(__NR_io_uring_enter, _ring->fd, toSubmit,
+                                minComplete, flags, nullptr, 0));
+        if (res >= 0)
+        {
+            _ring->toSubmit -= std::min(_ring->toSubmit, unsigned(res));
+            return res;
+        }
+        if (errno == EINTR)
+            continue;
+
+        // EBUSY/EAGAIN: очередь завершений переполнена, требуется обработать
+        // завершенные операции
+        return -errno;
+    }
+}
+
+void IoService::ringReap()
+{
+    Ring& r = *_ring;
+    unsigned head = *r.cqHead;
+    while (head != __atomic_load_n(r.cqTail, __ATOMIC_ACQUIRE))
+    {
+        io_uring_cqe cqe = r.cqes[head & r.cqMask];
+        __atomic_store_n(r.cqHead, ++head, __ATOMIC_RELEASE);
+
+        if (cqe.user_data == 0)
+        {
+            uint64_t val;
+            while (::read(_eventFd, &val, sizeof(val)) < 0 && errno == EINTR) {}
+            r.wakeupPending = false;
+            ringPollWakeup();
+            continue;
+        }
+
+        Batch* batch = (Batch*)uintptr_t(cqe.user_data);
+        if (complete(batch, cqe.res))
+            --_inflight;
+        else
+            ringSubmit(batch);
+    }
+}
+#endif // __linux__
+
+IoService& ioService()
+{
+    // Сервис намеренно не разрушается: деструктор логгера, который может быть
+    // вызван позже деструкторов статических объектов, ожидает  завершения
+    // асинхронной записи (см. Logger::stopImpl())
+    static IoService* service = new IoService;
+    return *service;
+}
+
+} // namespace trd
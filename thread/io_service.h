@@ -0,0 +1,165 @@
+/* clang-format off */
+/*****************************************************************************
+  The MIT License
+
+  Copyright © 2026 Pavel Karelin (hkarel), <hkarel@yandex.ru>
+
+  Permission is hereby granted, free of charge, to any person obtaining
+  a copy of this software and associated documentation files (the
+  "Software"), to deal in the Software without restriction, including
+  without limitation the rights to use, copy, modify, merge, publish,
+  distribute, sublicense, and/or sell copies of the Software, and to
+  permit persons to whom the Software is furnished to do so, subject to
+  the following conditions:
+
+  The above copyright notice and this permission notice shall be included
+  in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+  CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+  TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+  SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+  ---
+
+  Сервис асинхронного файлового ввода-вывода. Операции записи и синхрониза-
+  ции выполняются в отдельном потоке сервиса, вызывающий поток только ставит
+  операцию в очередь. В Linux для выполнения операций используется io_uring,
+  если io_uring недоступен (старое ядро, запрет системными политиками), или
+  для других ОС - операции выполняются вызовами pwritev()/fsync() в потоке
+  сервиса.
+  Операции над одним файлом выполняются строго в порядке постановки в оче-
+  редь. Все операции записи, накопленные для файла к моменту выполнения,
+  объединяются в один вызов writev
+*****************************************************************************/
+
+#pragma once
+
+#include "defmac.h"
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace trd {
+
+using namespace std;
+
+class IoService
+{
+public:
+    // Функция обратного вызова для завершенной операции. Параметр result
+    // для операции записи - количество записанных байт, для остальных опера-
+    // ций - 0. При ошибке result содержит отрицательный код ошибки (-errno).
+    // Функция вызывается в потоке сервиса и не должна выполняться долго
+    typedef function<void(int64_t result)> Callback;
+
+    enum class Backend
+    {
+        None    = 0, // Сервис не запущен
+        IoUring = 1,
+        Thread  = 2  // Поток с вызовами pwritev()/fsync()
+    };
+
+    IoService() = default;
+    ~IoService();
+
+    // Запускает сервис. Если параметр useIoUring = FALSE, то io_uring не
+    // используется. Повторный вызов для запущенного сервиса игнорируется
+    bool start(bool useIoUring = true);
+
+    // Останавливает сервис. Все операции, поставленные в очередь до вызова
+    // stop(), будут выполнены
+    void stop();
+
+    // Возвращает TRUE, когда сервис остановлен
+    bool stopped() const {return _backend == Backend::None;}
+
+    // Механизм выполнения операций
+    Backend backend() const {return _backend;}
+
+    // Регистрирует файловый дескриптор в сервисе, возвращает идентификатор
+    // файла или -1 если сервис не запущен. Запись выполняется в конец файла:
+    // начальное смещение определяется при регистрации, далее увеличивается
+    // на размер записанных данных
+    int registerFile(int fd);
+
+    // Снимает файл с регистрации после завершения всех ранее поставленных
+    // операций. Если closeFd = TRUE, то дескриптор файла будет закрыт. После
+    // вызова функции идентификатор fileId использовать нельзя
+    void releaseFile(int fileId, bool closeFd, Callback = nullptr);
+
+    // Ставит в очередь запись буферов в конец файла. Данные буферов переда-
+    // ются сервису. Возвращает FALSE, если сервис остановлен
+    bool append(int fileId, vector<string>&& buffers, Callback = nullptr);
+    bool append(int fileId, string&& buffer, Callback = nullptr);
+
+    // Ставит в очередь синхронизацию файла с диском. Синхронизация выполня-
+    // ется после завершения всех ранее поставленных операций записи
+    bool fsync(int fileId, bool dataOnly = true, Callback = nullptr);
+
+    // Ожидает завершения всех поставленных в очередь операций
+    void wait();
+
+    // Количество операций, ожидающих выполнения
+    uint64_t pending() const {return _pending;}
+
+private:
+    DISABLE_DEFAULT_COPY(IoService)
+
+    struct Op;
+    struct File;
+    struct Batch;
+    struct Ring;
+
+    bool enqueue(int fileId, Op&&);
+    void wakeup();
+    void run();
+
+    // Формирует пакеты операций для файлов, не имеющих выполняемых операций
+    void dispatch(vector<Batch*>&);
+
+    // Завершает выполнение пакета. Возвращает FALSE, если пакет требует
+    // повторной отправки (частичная запись)
+    bool complete(Batch*, int64_t result);
+
+    void executeThread(Batch*);
+
+#if defined(__linux__)
+    bool ringInit();
+    void ringFree();
+    bool ringSubmit(Batch*);
+    void ringPollWakeup();
+    int  ringEnter(unsigned toSubmit, unsigned minComplete);
+    void ringReap();
+#endif
+
+private:
+    atomic<Backend> _backend = {Backend::None};
+    atomic_bool _stop = {false};
+    atomic<uint64_t> _pending = {0};
+
+    thread _thread;
+    mutex  _startLock;
+
+    vector<File*> _files;
+    vector<int> _freeIds;
+    mutex _lock;
+    condition_variable _cond;     // Пробуждение потока (Backend::Thread)
+    condition_variable _idleCond; // Завершение всех операций (см. wait())
+
+    Ring* _ring = {nullptr};
+    int   _eventFd = {-1};
+    int   _inflight = {0};
+};
+
+IoService& ioService();
+
+} // namespace trd